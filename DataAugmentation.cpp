@@ -33,9 +33,30 @@
 
 #include "DataAugmentation.h"
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include "RandomRotation.h"
+#include "TransformKernels.h"
+#include "ImageLoader.h"
+#include "OutputCache.h"
+#include "Progress.h"
+#include "Scheduler.h"
+#include "FileScanner.h"
+#include "PlanLog.h"
 #include "Util.h"
 
 
@@ -60,125 +81,1854 @@ cv::Rect RandomDeformRect(const cv::Rect& input_rect, double x_slide_sigma, doub
 }
 
 
-cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area,
-	double yaw_sigma, double pitch_sigma, double roll_sigma,
-	double blur_max_sigma, double noise_max_sigma, double x_slide_sigma, double y_slide_sigma,
-	double aspect_range, double hflip_ratio, double vflip_ratio, cv::RNG& rng)
+AugmentationParams::AugmentationParams() :
+	num_generate(1), yaw_sigma(0), pitch_sigma(0), roll_sigma(0), blur_max_sigma(0), noise_max_sigma(0),
+	x_slide_sigma(0), y_slide_sigma(0), aspect_sigma(0), hflip_ratio(0), vflip_ratio(0),
+	brightness_sigma(0), contrast_sigma(0), gamma_sigma(0), hue_sigma(0), saturation_sigma(0),
+	whole_image(false), min_visible_ratio(0.5), load_unchanged(false), seed(0), verbose(false), num_threads(0), memory_budget_mb(0)
+{
+}
+
+
+// Noise smaller than this sigma rounds to no change practically (|noise| < 0.5 within 6 sigma)
+const double MIN_NOISE_SIGMA = 0.5 / 6;
+
+
+// Color matrix which rotates hue around gray axis and scales saturation in BGR space.
+// This approximates HSV jitter without color conversion round trip.
+cv::Mat HueSaturationMatrix(double hue, double saturation)
+{
+	// luminance weights in BGR order
+	const double weight[3] = { 0.114, 0.587, 0.299 };
+	// cross product with gray axis (1,1,1)
+	const double cross[3][3] = { { 0, -1, 1 }, { 1, 0, -1 }, { -1, 1, 0 } };
+
+	double cos_hue = cos(hue * CV_PI / 180);
+	double sin_hue = sin(hue * CV_PI / 180) / std::sqrt(3.0);
+
+	double sat_mat[3][3], rot_mat[3][3];
+	for (int i = 0; i < 3; i++){
+		for (int j = 0; j < 3; j++){
+			sat_mat[i][j] = (1 - saturation) * weight[j] + (i == j ? saturation : 0);
+			rot_mat[i][j] = (1 - cos_hue) / 3 + sin_hue * cross[i][j] + (i == j ? cos_hue : 0);
+		}
+	}
+
+	cv::Mat color_mat(3, 3, CV_64FC1);
+	for (int i = 0; i < 3; i++){
+		for (int j = 0; j < 3; j++){
+			double val = 0;
+			for (int k = 0; k < 3; k++){
+				val += rot_mat[i][k] * sat_mat[k][j];
+			}
+			color_mat.at<double>(i, j) = val;
+		}
+	}
+	return color_mat;
+}
+
+
+TransformPlan PlanImageTransform(const cv::Size& img_size, const cv::Rect& area, const AugmentationParams& params,
+	cv::RNG& rng)
 {
-	assert(img.type() == CV_8UC1 || img.type() == CV_8UC3);
+	TransformPlan plan;
 
 	// Deform Rect Randomly
-	cv::Rect rect = (area.width <= 0 || area.height <= 0) ? cv::Rect(0, 0, img.cols, img.rows) :
-		RandomDeformRect(area, x_slide_sigma, y_slide_sigma, aspect_range, rng);
+	plan.rect = (area.width <= 0 || area.height <= 0) ? cv::Rect(0, 0, img_size.width, img_size.height) :
+		RandomDeformRect(area, params.x_slide_sigma, params.y_slide_sigma, params.aspect_sigma, rng);
 
-	rect = util::TruncateRect(rect, img.size());
+	plan.rect = util::TruncateRect(plan.rect, img_size);
+	plan.output_size = params.output_size;
 
 	// Random Rotation
-	cv::Mat dst;
-	RandomRotateImage(img, dst, yaw_sigma, pitch_sigma, roll_sigma, rect, rng);
+	plan.yaw = rng.gaussian(params.yaw_sigma);
+	plan.pitch = rng.gaussian(params.pitch_sigma);
+	plan.roll = rng.gaussian(params.roll_sigma);
+	plan.rotate = (plan.yaw != 0 || plan.pitch != 0 || plan.roll != 0);
 
 	// Random Noise
-	double noise_sigma = rng.uniform(0.0, noise_max_sigma);
-	if (noise_sigma > 0){
-		cv::Mat gauss_noise(dst.size(), CV_32FC(dst.channels()));
-		cv::randn(gauss_noise, 0.0, noise_sigma);
-		int num = dst.cols * dst.rows * dst.channels();
-		unsigned char* dst_ptr = dst.data;
-		float* noise_ptr = (float*)gauss_noise.data;
-		for (int i = 0; i < num; i++){
-			int val = *dst_ptr + *noise_ptr;
-			*dst_ptr = (val > 255) ? 255 : (val < 0) ? 0 : val;
-			dst_ptr++, noise_ptr++;
-		}
-	}
+	plan.noise_sigma = rng.uniform(0.0, params.noise_max_sigma);
+	plan.noise = (plan.noise_sigma >= MIN_NOISE_SIGMA);
+	plan.noise_seed = plan.noise ? (unsigned int)rng : 0;
 
 	// Random Blur
-	cv::Mat dst2;
-	double blur_sigma = rng.uniform(0.0, blur_max_sigma);
-	int size = blur_sigma * 2.5 + 0.5;
-	size += (1 - size % 2);
-	if (blur_sigma > 0 && size >= 3){
-		cv::Size ksize(size, size);
-		cv::GaussianBlur(dst, dst2, ksize, blur_sigma);
+	plan.blur_sigma = rng.uniform(0.0, params.blur_max_sigma);
+	plan.blur_size = plan.blur_sigma * 2.5 + 0.5;
+	plan.blur_size += (1 - plan.blur_size % 2);
+	plan.blur = (plan.blur_sigma > 0 && plan.blur_size >= 3);
+
+	// Rondom Flip
+	double flip_prob = rng.uniform(0.0, 1.0);
+	plan.hflip = (params.hflip_ratio > flip_prob);
+	flip_prob = rng.uniform(0.0, 1.0);
+	plan.vflip = (params.vflip_ratio > flip_prob);
+
+	// Random photometric change (drawn only if enabled to keep the random sequence of the other stages)
+	plan.brightness = (params.brightness_sigma > 0) ? rng.gaussian(params.brightness_sigma) : 0;
+	plan.contrast = (params.contrast_sigma > 0) ? std::max(1.0 + rng.gaussian(params.contrast_sigma), 0.0) : 1;
+	plan.gamma = (params.gamma_sigma > 0) ? std::exp(rng.gaussian(params.gamma_sigma)) : 1;
+	plan.hue = (params.hue_sigma > 0) ? rng.gaussian(params.hue_sigma) : 0;
+	plan.saturation = (params.saturation_sigma > 0) ? std::max(1.0 + rng.gaussian(params.saturation_sigma), 0.0) : 1;
+	plan.lut = (plan.brightness != 0 || plan.contrast != 1 || plan.gamma != 1);
+	plan.color = (plan.hue != 0 || plan.saturation != 1);
+
+	return plan;
+}
+
+
+TransformPlan PlanImageTransform(const cv::Size& img_size, const cv::Rect& area, const AugmentationParams& params)
+{
+	cv::RNG rng;
+	return PlanImageTransform(img_size, area, params, rng);
+}
+
+
+void ExecuteTransformPlan(const cv::Mat& img, const TransformPlan& plan, cv::Mat& dst, cv::Mat& homography,
+	const RotationWarp* warp, MipPyramid* pyramid)
+{
+	assert(IsSupportedImageType(img.type()));
+
+	// Rotation writes into dst. Without rotation, the input image is referred without copy.
+	cv::Mat src;
+	bool in_dst;
+	if (plan.rotate && warp){
+		ApplyRotationWarp(img, RotationSourceRect(img.size(), plan.rect), *warp, dst, homography,
+			cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0), pyramid);
+		src = dst;
+		in_dst = true;
+	}
+	else if (plan.rotate){
+		// Sample mip levels of the shared pyramid where source is heavily minified
+		bool rotated = false;
+		if (pyramid){
+			cv::Rect src_rect;
+			cv::Size dst_size;
+			homography = RotationHomography(img.size(), plan.rect, plan.yaw, plan.pitch, plan.roll, src_rect, dst_size,
+				1000, plan.output_size);
+			rotated = WarpPerspectiveMip(*pyramid, src_rect, dst, dst_size, homography);
+		}
+		if (!rotated){
+			RotateImageArea(img, dst, homography, plan.yaw, plan.pitch, plan.roll, plan.rect,
+				1000, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0), plan.output_size, pyramid);
+		}
+		src = dst;
+		in_dst = true;
 	}
 	else{
-		dst2 = dst;
+		cv::Rect crop_rect = UnrotatedArea(img.size(), plan.rect);
+		homography = cv::Mat::eye(3, 3, CV_64FC1);
+		homography.at<double>(0, 2) = -crop_rect.x;
+		homography.at<double>(1, 2) = -crop_rect.y;
+		src = img(crop_rect);
+		in_dst = false;
+
+		// Resize to output size (the first copy from input image is merged into resize)
+		if (plan.output_size.area() > 0 && plan.output_size != crop_rect.size()){
+			bool shrink = (plan.output_size.width < crop_rect.width || plan.output_size.height < crop_rect.height);
+			cv::resize(src, dst, plan.output_size, 0, 0, shrink ? cv::INTER_AREA : cv::INTER_LINEAR);
+			homography = ResizeHomography(crop_rect.size(), plan.output_size) * homography;
+			src = dst;
+			in_dst = true;
+		}
 	}
 
-	// Rondom Flip (horizontal)
-	cv::Mat dst3;
-	double flip_prob = rng.uniform(0.0, 1.0);
-	if (hflip_ratio > flip_prob) {
-		cv::flip(dst2, dst3, 1);
+	// Hue and saturation (color image only, alpha channel is kept)
+	if (plan.color && img.channels() >= 3){
+		cv::Mat color_mat = cv::Mat::eye(img.channels(), img.channels(), CV_64FC1);
+		HueSaturationMatrix(plan.hue, plan.saturation).copyTo(color_mat(cv::Rect(0, 0, 3, 3)));
+		cv::transform(src, dst, color_mat);
+		src = dst;
+		in_dst = true;
 	}
-	else {
-		dst3 = dst2;
+
+	// Brightness, contrast, and gamma in one lookup table
+	if (plan.lut){
+		ApplyToneCurve(src, dst, plan.brightness, plan.contrast, plan.gamma);
+		src = dst;
+		in_dst = true;
 	}
 
-	// Rondom Flip (vertical)
-	cv::Mat dst4;
-	flip_prob = rng.uniform(0.0, 1.0);
-	if (vflip_ratio > flip_prob) {
-		cv::flip(dst3, dst4, 0);
+	// Noise
+	if (plan.noise){
+		if (!in_dst){
+			src.copyTo(dst);
+			src = dst;
+			in_dst = true;
+		}
+		AddGaussianNoise(dst, plan.noise_sigma, plan.noise_seed);
 	}
-	else {
-		dst4 = dst3;
+
+	// Blur (the first copy from input image is merged into blur)
+	if (plan.blur){
+		int border = in_dst ? cv::BORDER_DEFAULT : (cv::BORDER_DEFAULT | cv::BORDER_ISOLATED);
+		cv::GaussianBlur(src, dst, cv::Size(plan.blur_size, plan.blur_size), plan.blur_sigma, 0, border);
+		src = dst;
+		in_dst = true;
+	}
+
+	// Flip (the first copy from input image is merged into flip)
+	if (in_dst){
+		FlipInPlace(dst, plan.hflip, plan.vflip);
+	}
+	else if (plan.hflip || plan.vflip){
+		int flip_code = (plan.hflip && plan.vflip) ? -1 : plan.hflip ? 1 : 0;
+		cv::flip(src, dst, flip_code);
+	}
+	else{
+		src.copyTo(dst);
 	}
-	return dst4;
 }
 
 
-void DataAugmentation(const std::vector<std::string>& img_files, const std::vector<std::vector<cv::Rect>>& areas,
-	const std::string& output_folder, const std::string& output_file,
-	int num_generate, double yaw_range, double pitch_range, double roll_range,
-	double blur_sigma, double noise_sigma, double x_slide, double y_slide, double aspect_range,
-	double hflip_ratio, double vflip_ratio)
+std::ostream& operator<<(std::ostream& os, const TransformPlan& plan)
 {
-	assert(areas.empty() || areas.size() == img_files.size());
+	os << "rect=" << plan.rect;
+	if (plan.output_size.area() > 0){
+		os << " output=" << plan.output_size;
+	}
+	bool identity = true;
+	if (plan.rotate){
+		os << " rotate(yaw=" << plan.yaw << ", pitch=" << plan.pitch << ", roll=" << plan.roll << ")";
+		identity = false;
+	}
+	if (plan.color){
+		os << " color(hue=" << plan.hue << ", saturation=" << plan.saturation << ")";
+		identity = false;
+	}
+	if (plan.lut){
+		os << " lut(brightness=" << plan.brightness << ", contrast=" << plan.contrast << ", gamma=" << plan.gamma << ")";
+		identity = false;
+	}
+	if (plan.noise){
+		os << " noise(sigma=" << plan.noise_sigma << ", seed=" << plan.noise_seed << ")";
+		identity = false;
+	}
+	if (plan.blur){
+		os << " blur(ksize=" << plan.blur_size << ", sigma=" << plan.blur_sigma << ")";
+		identity = false;
+	}
+	if (plan.hflip || plan.vflip){
+		os << " flip(" << (plan.hflip ? "h" : "") << (plan.vflip ? "v" : "") << ")";
+		identity = false;
+	}
+	if (identity){
+		os << " copy";
+	}
+	return os;
+}
+
+
+cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area, const AugmentationParams& params,
+	cv::RNG& rng, TransformPlan* drawn_plan)
+{
+	TransformPlan plan = PlanImageTransform(img.size(), area, params, rng);
+	if (drawn_plan)
+		*drawn_plan = plan;
+
+	cv::Mat dst, homography;
+	ExecuteTransformPlan(img, plan, dst, homography);
+	return dst;
+}
+
+
+cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area, const AugmentationParams& params)
+{
+	cv::RNG rng;
+	return ImageTransform(img, area, params, rng);
+}
+
+
+cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area,
+	double yaw_sigma, double pitch_sigma, double roll_sigma,
+	double blur_max_sigma, double noise_max_sigma, double x_slide_sigma, double y_slide_sigma,
+	double aspect_range, double hflip_ratio, double vflip_ratio, cv::RNG& rng)
+{
+	AugmentationParams params;
+	params.yaw_sigma = yaw_sigma;
+	params.pitch_sigma = pitch_sigma;
+	params.roll_sigma = roll_sigma;
+	params.blur_max_sigma = blur_max_sigma;
+	params.noise_max_sigma = noise_max_sigma;
+	params.x_slide_sigma = x_slide_sigma;
+	params.y_slide_sigma = y_slide_sigma;
+	params.aspect_sigma = aspect_range;
+	params.hflip_ratio = hflip_ratio;
+	params.vflip_ratio = vflip_ratio;
+	return ImageTransform(img, area, params, rng);
+}
 
-	using namespace boost::filesystem;
 
+cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area,
+	double yaw_sigma, double pitch_sigma, double roll_sigma,
+	double blur_max_sigma, double noise_max_sigma, double x_slide_sigma, double y_slide_sigma,
+	double aspect_range, double hflip_ratio, double vflip_ratio)
+{
 	cv::RNG rng;
-	int num_img = img_files.size();
-	for (int i = 0; i < num_img; i++){
-		std::cout << "Load " << img_files[i] << std::endl;
-		cv::Mat img = cv::imread(img_files[i]);
-		if (img.empty())
+	return ImageTransform(img, area, yaw_sigma, pitch_sigma, roll_sigma, blur_max_sigma, noise_max_sigma,
+		x_slide_sigma, y_slide_sigma, aspect_range, hflip_ratio, vflip_ratio, rng);
+}
+
+
+// Apply homography and flip of plan to rectangles, clip them, and remove the ones which are mostly out of image
+void TransformObjectRects(const std::vector<cv::Rect>& rects, const TransformPlan& plan, const cv::Mat& homography,
+	const cv::Size& img_size, double min_visible_ratio, std::vector<cv::Rect>& dst_rects)
+{
+	cv::Rect_<double> img_rect(0, 0, img_size.width, img_size.height);
+	dst_rects.clear();
+	for (int i = 0; i < rects.size(); i++){
+		cv::Rect_<double> trans_rect = TransformRect(rects[i], homography);
+		double area = trans_rect.area();
+		cv::Rect_<double> clip_rect = trans_rect & img_rect;
+		if (area <= 0 || clip_rect.area() <= 0 || clip_rect.area() < min_visible_ratio * area)
 			continue;
+		int x1 = cvRound(clip_rect.x);
+		int y1 = cvRound(clip_rect.y);
+		int x2 = cvRound(clip_rect.x + clip_rect.width);
+		int y2 = cvRound(clip_rect.y + clip_rect.height);
+		cv::Rect rect(x1, y1, x2 - x1, y2 - y1);
+		if (plan.hflip)
+			rect.x = img_size.width - rect.x - rect.width;
+		if (plan.vflip)
+			rect.y = img_size.height - rect.y - rect.height;
+		dst_rects.push_back(rect);
+	}
+}
+
+
+cv::Mat ImageTransformWithRects(const cv::Mat& img, const std::vector<cv::Rect>& rects, std::vector<cv::Rect>& dst_rects,
+	const AugmentationParams& params, cv::RNG& rng, TransformPlan* drawn_plan)
+{
+	// Whole image is transformed without deformation of area
+	TransformPlan plan = PlanImageTransform(img.size(), cv::Rect(), params, rng);
+	if (drawn_plan)
+		*drawn_plan = plan;
+
+	cv::Mat dst, homography;
+	ExecuteTransformPlan(img, plan, dst, homography);
+	TransformObjectRects(rects, plan, homography, dst.size(), params.min_visible_ratio, dst_rects);
+	return dst;
+}
+
+
+cv::Mat ImageTransformWithRects(const cv::Mat& img, const std::vector<cv::Rect>& rects, std::vector<cv::Rect>& dst_rects,
+	const AugmentationParams& params)
+{
+	cv::RNG rng;
+	return ImageTransformWithRects(img, rects, dst_rects, params, rng);
+}
+
+
+// Bytes of maps of sweep warps kept in cache without memory budget
+const long long MAX_SWEEP_CACHE_BYTES = 256LL * 1024 * 1024;
+
+// With memory budget, 1/SWEEP_CACHE_BUDGET_DIVISOR of it is given to cached sweep warps, and the rest to tasks
+const int SWEEP_CACHE_BUDGET_DIVISOR = 4;
+
+
+// Memory budget of tasks. In sweep mode, a part of the budget is given to cached sweep warps.
+long long TaskBudgetBytes(const AugmentationParams& params, bool sweep)
+{
+	long long budget = (long long)params.memory_budget_mb * 1024 * 1024;
+	return sweep ? budget - budget / SWEEP_CACHE_BUDGET_DIVISOR : budget;
+}
+
 
-		cv::Rect pos(0, 0, img.cols, img.rows);
-		std::vector <cv::Rect> trans_areas;
-		if (areas.empty()){
-			trans_areas.push_back(pos);
+// Threads of OpenCV (cv::parallel_for_() of large warps, resize, blur, etc.) are limited to one while tasks run on
+// several threads, so that they are not nested in the threads of the pool. It is restored at the end of scope.
+class OpenCVThreadScope
+{
+public:
+	explicit OpenCVThreadScope(int pool_threads) : num_threads_(cv::getNumThreads()), limited_(pool_threads > 1)
+	{
+		if (limited_)
+			cv::setNumThreads(1);
+	}
+
+	~OpenCVThreadScope()
+	{
+		if (limited_)
+			cv::setNumThreads(num_threads_);
+	}
+
+private:
+	int num_threads_;
+	bool limited_;
+};
+
+
+// Rotation warps of poses in sweep grid, cached by source size, area size and pose.
+// Each warp is computed by the first thread which needs it outside of the lock of the cache,
+// so that threads wait only for the warp they need. Least recently used warps are dropped beyond max_bytes.
+class SweepWarpCache
+{
+public:
+	SweepWarpCache(const std::vector<cv::Vec3d>& poses, const cv::Size& output_size, long long max_bytes) :
+		poses_(poses), output_size_(output_size), max_bytes_(max_bytes), bytes_(0), use_count_(0){}
+
+	//! Warp of pose k for area in image of img_size. It is computed at the first call for the sizes and the pose.
+	/*!
+	Warp is returned by copy (maps are shared), so that it is valid after it is dropped from the cache by another thread.
+	*/
+	RotationWarp GetWarp(const cv::Size& img_size, const cv::Rect& area, int k)
+	{
+		cv::Size src_size = RotationSourceRect(img_size, area).size();
+		std::vector<int> key;
+		key.push_back(src_size.width);
+		key.push_back(src_size.height);
+		key.push_back(area.width);
+		key.push_back(area.height);
+		key.push_back(k);
+
+		std::shared_ptr<Entry> entry;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::shared_ptr<Entry>& cached = cache_[key];
+			if (!cached)
+				cached.reset(new Entry());
+			cached->last_use = ++use_count_;
+			entry = cached;
 		}
-		else{
-			trans_areas = areas[i];
-		}
-
-		for (int j = 0; j < trans_areas.size(); j++){
-			std::stringstream filestr;
-			filestr << "img" << i << "_" << j;
-			
-			for (int k = 0; k < num_generate; k++){
-				cv::Mat tran_img = ImageTransform(img, trans_areas[j], yaw_range, pitch_range, roll_range,
-					blur_sigma, noise_sigma, x_slide, y_slide, aspect_range, hflip_ratio, vflip_ratio, rng);
-				std::stringstream filestr2;
-				filestr2 << filestr.str() << "_" << k << ".png";
-				path dst_file = path(output_folder) / path(filestr2.str());
-				std::string save_img_name = dst_file.string();
-
-				std::cout << "Save image " << save_img_name << "...";
-				if (cv::imwrite(dst_file.string(), tran_img)){
-					std::vector<cv::Rect> pos;
-					pos.push_back(cv::Rect(0,0,tran_img.cols, tran_img.rows));
-					util::AddAnnotationLine(output_file, dst_file.string(), pos, " ");
-					std::cout << "succeed";
-				}
-				else{
-					std::cout << "fail";
-				}
-				std::cout << std::endl;
+
+		std::call_once(entry->computed, &SweepWarpCache::Compute, this, std::ref(*entry), src_size, area.size(), k);
+
+		// Bytes are counted once by the thread which computed the warp, unless it has been dropped meanwhile
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!entry->counted){
+			entry->counted = true;
+			std::map<std::vector<int>, std::shared_ptr<Entry>>::iterator it = cache_.find(key);
+			if (it != cache_.end() && it->second == entry){
+				bytes_ += entry->bytes;
+				Shrink(key);
+			}
+		}
+		return entry->warp;
+	}
+
+private:
+	struct Entry
+	{
+		Entry() : bytes(0), counted(false), last_use(0){}
+
+		std::once_flag computed;
+		RotationWarp warp;
+		long long bytes;			// bytes of maps
+		bool counted;				// bytes are counted in bytes_
+		unsigned long long last_use;
+	};
+
+	void Compute(Entry& entry, const cv::Size& src_size, const cv::Size& area_size, int k)
+	{
+		PrepareRotationWarp(src_size, area_size, poses_[k][0], poses_[k][1], poses_[k][2], entry.warp, true, 1000, output_size_);
+		entry.bytes = (long long)(entry.warp.map1.total() * entry.warp.map1.elemSize() + entry.warp.map2.total() * entry.warp.map2.elemSize());
+	}
+
+	// Drop least recently used warps until bytes fit in max_bytes_. The warp of keep is not dropped.
+	void Shrink(const std::vector<int>& keep)
+	{
+		while (bytes_ > max_bytes_){
+			std::map<std::vector<int>, std::shared_ptr<Entry>>::iterator oldest = cache_.end();
+			for (std::map<std::vector<int>, std::shared_ptr<Entry>>::iterator it = cache_.begin(); it != cache_.end(); it++){
+				if (it->second->counted && it->first != keep && (oldest == cache_.end() || it->second->last_use < oldest->second->last_use))
+					oldest = it;
+			}
+			if (oldest == cache_.end())
+				break;
+			bytes_ -= oldest->second->bytes;
+			cache_.erase(oldest);
+		}
+	}
+
+	std::vector<cv::Vec3d> poses_;
+	cv::Size output_size_;
+	long long max_bytes_;
+	long long bytes_;			// bytes of computed warps in cache
+	unsigned long long use_count_;
+	std::map<std::vector<int>, std::shared_ptr<Entry>> cache_;
+	std::mutex mutex_;
+};
+
+
+// All combinations of angles in sweep lists. Empty list means zero.
+std::vector<cv::Vec3d> PoseGrid(const std::vector<double>& yaw_list, const std::vector<double>& pitch_list,
+	const std::vector<double>& roll_list)
+{
+	std::vector<double> yaws = yaw_list.empty() ? std::vector<double>(1, 0.0) : yaw_list;
+	std::vector<double> pitches = pitch_list.empty() ? std::vector<double>(1, 0.0) : pitch_list;
+	std::vector<double> rolls = roll_list.empty() ? std::vector<double>(1, 0.0) : roll_list;
+
+	std::vector<cv::Vec3d> poses;
+	for (int i = 0; i < yaws.size(); i++){
+		for (int j = 0; j < pitches.size(); j++){
+			for (int k = 0; k < rolls.size(); k++){
+				poses.push_back(cv::Vec3d(yaws[i], pitches[j], rolls[k]));
+			}
+		}
+	}
+	return poses;
+}
+
+
+std::vector<cv::Vec3d> SweepPoses(const AugmentationParams& params)
+{
+	if (params.yaw_sweep.empty() && params.pitch_sweep.empty() && params.roll_sweep.empty())
+		return std::vector<cv::Vec3d>();
+	return PoseGrid(params.yaw_sweep, params.pitch_sweep, params.roll_sweep);
+}
+
+
+// Tag of pose written in annotation line
+std::string PoseTag(const TransformPlan& plan)
+{
+	std::stringstream tag;
+	tag << "yaw=" << plan.yaw << " pitch=" << plan.pitch << " roll=" << plan.roll;
+	return tag.str();
+}
+
+
+// Maximum reduction of JPEG decoding
+const int MAX_DECODE_REDUCTION = 8;
+
+// Version of output cache. Increment it when rendering changes.
+const int CACHE_VERSION = 6;
+
+
+// Plan to load the region and the resolution of image which samples of areas need.
+// Coordinates on loaded image are ReduceRect(original, reduction) - rect.tl().
+SourceLoad PlanSourceLoad(const std::string& file, const std::vector<cv::Rect>& areas, const AugmentationParams& params)
+{
+	SourceLoad load;
+	load.region = false;
+	load.reduction = 1;
+
+	cv::Size img_size;
+	if (params.load_unchanged || !ReadJpegSize(file, img_size))
+		return load;
+
+	cv::Rect img_rect(0, 0, img_size.width, img_size.height);
+	bool whole = (areas.empty() || params.whole_image);
+
+	// Decode at reduced size as long as it keeps the resolution of output
+	if (params.output_size.area() > 0){
+		std::vector<cv::Rect> target_areas = whole ? std::vector<cv::Rect>(1, img_rect) : areas;
+		double max_scale = 0;
+		for (int j = 0; j < target_areas.size(); j++){
+			cv::Rect rect = util::TruncateRect(target_areas[j], img_size);
+			if (rect.width <= 0 || rect.height <= 0)
+				rect = img_rect;
+			max_scale = std::max(max_scale, std::max((double)params.output_size.width / rect.width,
+				(double)params.output_size.height / rect.height));
+		}
+		while (load.reduction < MAX_DECODE_REDUCTION && max_scale * load.reduction * 2 <= 1)
+			load.reduction *= 2;
+	}
+	cv::Size reduced_size((img_size.width + load.reduction - 1) / load.reduction, (img_size.height + load.reduction - 1) / load.reduction);
+	load.rect = cv::Rect(0, 0, reduced_size.width, reduced_size.height);
+	load.region = true;
+
+	// Union of rotation source rects of all areas.
+	// It gives the same result as whole image since truncation by it is the same as by image.
+	// Slide and aspect change move areas randomly, so whole image is needed with them.
+	// Without region decoding, whole image is decoded anyway and it is kept without cropping.
+	if (CanDecodeRegion() && !whole && params.x_slide_sigma == 0 && params.y_slide_sigma == 0 && params.aspect_sigma == 0){
+		cv::Rect bounds;
+		for (int j = 0; j < areas.size(); j++){
+			cv::Rect rect = util::TruncateRect(ReduceRect(areas[j], load.reduction), reduced_size);
+			if (rect.width <= 0 || rect.height <= 0){
+				// Empty area uses whole image
+				bounds = load.rect;
+				break;
 			}
+			cv::Rect src_rect = RotationSourceRect(reduced_size, rect) | rect;
+			bounds = (j == 0) ? src_rect : (bounds | src_rect);
+		}
+		load.rect = bounds;
+	}
+	return load;
+}
+
+
+// Load source image as planned. load.rect is set to whole image if it is decoded by cv::imread().
+cv::Mat LoadSourceImage(const std::string& file, const AugmentationParams& params, SourceLoad& load)
+{
+	if (load.region)
+		return LoadImageRegion(file, cv::IMREAD_COLOR, load.reduction, load.rect);
+
+	cv::Mat img = cv::imread(file, params.load_unchanged ? cv::IMREAD_UNCHANGED : cv::IMREAD_COLOR);
+	load.rect = cv::Rect(0, 0, img.cols, img.rows);
+	return img;
+}
+
+
+// Loads regions of image planned by load (on the loaded image) for mip levels of its tiles
+class SourceRegionLoader : public MipRegionLoader
+{
+public:
+	SourceRegionLoader(const std::string& file, const AugmentationParams& params, const SourceLoad& load) :
+		file_(file), params_(params), load_(load){}
+
+	cv::Mat Load(const cv::Rect& rect)
+	{
+		SourceLoad region = load_;
+		region.rect = rect + load_.rect.tl();
+		return LoadSourceImage(file_, params_, region);
+	}
+
+private:
+	const std::string& file_;
+	const AugmentationParams& params_;
+	SourceLoad load_;
+};
+
+
+// Parameters which determine output images except seed and num_generate (each sample has its own seed).
+// Tiled image shares the key, since its mip levels are the same as those of the loaded image.
+// Loaded image is cropped to the areas only with region decoding, which changes mip levels near the edges of the crop.
+std::string ParamsKey(const AugmentationParams& params, const SourceLoad& load)
+{
+	std::stringstream key;
+	key.precision(17);
+	key << CACHE_VERSION << " " << params.yaw_sigma << " " << params.pitch_sigma << " " << params.roll_sigma << " "
+		<< params.blur_max_sigma << " " << params.noise_max_sigma << " "
+		<< params.x_slide_sigma << " " << params.y_slide_sigma << " " << params.aspect_sigma << " "
+		<< params.hflip_ratio << " " << params.vflip_ratio << " "
+		<< params.brightness_sigma << " " << params.contrast_sigma << " " << params.gamma_sigma << " "
+		<< params.hue_sigma << " " << params.saturation_sigma << " "
+		<< params.whole_image << " " << params.min_visible_ratio << " " << params.load_unchanged << " "
+		<< params.output_size.width << " " << params.output_size.height << " " << load.reduction << " " << CanDecodeRegion();
+	const std::vector<double>* sweeps[3] = { &params.yaw_sweep, &params.pitch_sweep, &params.roll_sweep };
+	for (int i = 0; i < 3; i++){
+		key << " [";
+		for (int j = 0; j < sweeps[i]->size(); j++){
+			key << " " << (*sweeps[i])[j];
 		}
+		key << " ]";
+	}
+	return key.str();
+}
+
+
+// Seed of sample k of rects in image file. It does not depend on the order of images.
+unsigned long long SampleSeed(unsigned int seed, const std::string& file, const std::vector<cv::Rect>& rects, int k)
+{
+	unsigned long long hash = util::HashBytes(&seed, sizeof(seed));
+	hash = util::HashBytes(file.data(), file.size(), hash);
+	for (int i = 0; i < rects.size(); i++){
+		int values[4] = { rects[i].x, rects[i].y, rects[i].width, rects[i].height };
+		hash = util::HashBytes(values, sizeof(values), hash);
+	}
+	return util::HashBytes(&k, sizeof(k), hash);
+}
+
+
+// Cache key of sample (FNV-1a 128 bit in hex)
+std::string SampleCacheKey(unsigned long long sample_seed, unsigned long long content_hash, const std::string& params_key)
+{
+	util::Hash128 hash = util::HashBytes128(&sample_seed, sizeof(sample_seed));
+	hash = util::HashBytes128(&content_hash, sizeof(content_hash), hash);
+	hash = util::HashBytes128(params_key.data(), params_key.size(), hash);
+
+	char key[33];
+	snprintf(key, sizeof(key), "%016llx%016llx", hash.high, hash.low);
+	return std::string(key);
+}
+
+
+// Size of file (0 if it fails)
+long long FileBytes(const std::string& file)
+{
+	boost::system::error_code ec;
+	boost::uintmax_t size = boost::filesystem::file_size(file, ec);
+	return ec ? 0 : (long long)size;
+}
+
+
+// Lock of console output of threads
+std::mutex log_mutex;
+
+
+// Print line from thread
+void Log(const std::string& msg, bool flush)
+{
+	std::lock_guard<std::mutex> lock(log_mutex);
+	std::cout << msg;
+	if (flush)
+		std::cout << std::endl;
+	else
+		std::cout << "\n";
+}
+
+
+// Name of output image of sample k of area j of image i (without extension)
+std::string SampleName(int i, int j, int k, bool whole_image)
+{
+	std::stringstream name;
+	if (whole_image){
+		name << "img" << i << "_" << k;
+	}
+	else{
+		name << "img" << i << "_" << j << "_" << k;
 	}
+	return name.str();
+}
+
+
+// One output image of DataAugmentation()
+struct SampleJob
+{
+	int area_index;
+	int sample_index;
+	unsigned long long seed;
+	std::string key;
+	std::string dst_file;
+	bool cached;
+	bool saved;			// output image is in output folder (rendered or cached)
+	std::vector<cv::Rect> dst_rects;
+	std::string tag;
+};
+
+
+// Rotation samples area expanded by sqrt(2) in both directions (see RotationSourceRect()),
+// so it costs about twice as much as the area itself
+const double ROTATION_COST = 2.0;
+
+// Rough number of pixels decoded per byte of compressed file, used for the cost before decoding
+const double PIXELS_PER_BYTE = 4.0;
+
+// Samples of one image are split into tasks of about total cost / (threads * TASKS_PER_THREAD),
+// so that a large image does not run alone on one thread at the end
+const int TASKS_PER_THREAD = 8;
+
+// Images are fed to threads by windows of threads * SOURCES_PER_THREAD images, and samples run largest first within a window
+const int SOURCES_PER_THREAD = 4;
+
+// Images are added while the images not written yet are less than this number of windows
+const int MAX_UNWRITTEN_WINDOWS = 4;
+
+// Mip levels of loaded image add 1/3 of its pixels
+const double MIP_PIXEL_RATIO = 4.0 / 3.0;
+
+// Bytes per output pixel of the map of rotation (x and y in float, which MAP_DOUBLE also stores)
+const double MAP_BYTES_PER_PIXEL = 2 * sizeof(float);
+
+
+// Type of loaded image counted in memory budget before it is loaded.
+// Images are decoded to 8 bit BGR. Images loaded unchanged are counted as 16 bit BGRA, the largest type supported.
+int BudgetImageType(const AugmentationParams& params)
+{
+	return params.load_unchanged ? CV_16UC4 : CV_8UC3;
+}
+
+
+// Bytes of loaded image (or tile) of size with its mip levels
+long long SourceBytes(const cv::Size& size, const AugmentationParams& params)
+{
+	return (long long)(size.area() * MIP_PIXEL_RATIO * CV_ELEM_SIZE(BudgetImageType(params)));
+}
+
+
+// Bytes of buffers of one sample of area: output image and an intermediate image for color, tone, and blur.
+// Rotation also needs the area shrunk by the prefilter before sampling (about ROTATION_COST times the output),
+// and the map of output pixels.
+long long SampleBytes(const cv::Size& area_size, const AugmentationParams& params, bool rotate)
+{
+	double pixels = (params.output_size.area() > 0) ? params.output_size.area() : (double)area_size.area();
+	int pixel_bytes = CV_ELEM_SIZE(BudgetImageType(params));
+	double bytes = pixels * pixel_bytes * 2;
+	if (rotate)
+		bytes += pixels * (pixel_bytes * ROTATION_COST + MAP_BYTES_PER_PIXEL);
+	return (long long)bytes;
+}
+
+
+// Estimated cost of one sample of area (number of pixels rendered)
+double SampleCost(const cv::Size& area_size, const AugmentationParams& params, bool rotate)
+{
+	double pixels = (params.output_size.area() > 0) ? params.output_size.area() : (double)area_size.area();
+	return rotate ? pixels * ROTATION_COST : pixels;
+}
+
+
+// Size of image before decoding: size in JPEG header, or square of the pixels estimated from file size
+cv::Size GuessImageSize(const std::string& file, long long bytes)
+{
+	cv::Size size;
+	if (ReadJpegSize(file, size))
+		return size;
+	int side = cvRound(std::sqrt(bytes * PIXELS_PER_BYTE));
+	return cv::Size(side, side);
+}
+
+
+// Region of loaded image which samples of area need.
+// Truncation by it gives the same result as by the loaded image, as the union of them in PlanSourceLoad().
+cv::Rect AreaTile(const cv::Size& img_size, const cv::Rect& area)
+{
+	cv::Rect rect = util::TruncateRect(area, img_size);
+	if (rect.width <= 0 || rect.height <= 0)
+		return cv::Rect(0, 0, img_size.width, img_size.height);
+	return RotationSourceRect(img_size, rect) | rect;
+}
+
+
+// Input image shared by its tasks. It is prepared by the first task and released by the last one.
+// Image which exceeds memory budget alone is tiled: it is not loaded at once, and each area is loaded by its samples.
+struct SourceState
+{
+	SourceState() : has_areas(false), num_areas(1), load_cost(0), claimed(false), prepared(false), ok(false), planned(false), tiled(false), bytes(0), charged(false),
+		remaining_tasks(0), finished(false){}
+
+	std::string file;
+	std::vector<cv::Rect> obj_rects;	// annotated rectangles in file (empty without annotation)
+	bool has_areas;						// file is annotated (image without objects generates nothing)
+	int num_areas;						// whole image has one area
+	double load_cost;					// estimated cost of loading
+	std::vector<double> sample_costs;	// estimated cost of each sample (empty if image generates nothing)
+	std::vector<long long> sample_bytes;	// bytes of buffers of each sample
+	std::atomic<bool> claimed;			// the first task which starts prepares image
+	std::mutex prepare_mutex;
+	std::condition_variable prepare_cond;
+	bool prepared;						// guarded by prepare_mutex
+	bool ok;							// image is loaded (or tiled), or all samples are cached
+	bool planned;						// load, img_size, and img_areas are set (also when image is not decoded)
+	bool tiled;
+	long long bytes;					// bytes of loaded image (largest tile if tiled) counted in memory budget
+	bool charged;						// bytes of loaded image are counted by the task which prepares it
+	SourceLoad load;
+	cv::Mat img;
+	cv::Size img_size;					// size of loaded image
+	std::vector<cv::Rect> img_areas;	// annotated rectangles on img
+	std::unique_ptr<MipPyramid> pyramid;
+	std::vector<SampleJob> jobs;		// samples in order of area and index
+	std::atomic<int> remaining_tasks;
+	bool finished;						// all tasks are finished (guarded by write mutex)
+};
+
+
+// Samples [begin, end) of jobs of input image
+struct SampleTask
+{
+	int source;
+	int begin, end;
+	long long bytes;		// bytes of buffers of samples counted in memory budget
+};
+
+
+// Pipeline of DataAugmentation().
+// Input images are added while the pipeline runs, and output images are numbered through all of them.
+// Images are fed to one TaskPool by windows. Samples of a window are split into tasks, which run largest first,
+// and the next window is fed when they are almost all started, so that threads do not wait for the rest of the window.
+// Add() waits while too many images are not written, so that a slow image does not pile up the images after it.
+// The first task of an image loads it and looks up the cache for all its samples, and the other tasks wait for it.
+// Every sample has its own seed, so output images do not depend on the number of threads or the order of tasks.
+class AugmentationPipeline : public TaskBody
+{
+public:
+	AugmentationPipeline(const std::string& output_folder, const std::string& output_file, const AugmentationParams& params);
+
+	//! Queue batch of images. It returns without waiting for them, but waits while many images added before are not written.
+	void Add(const std::vector<std::string>& img_files, const std::vector<std::vector<cv::Rect>>& areas);
+
+	//! Wait until all added images are finished
+	void Finish();
+
+	void operator()(int t);
+
+private:
+	SourceState& Source(int i);
+	SampleTask Task(int t);
+	static int PlanTaskId(int i) { return -1 - i; }
+	void Feed();
+	void PlanSource(int i);
+	void QueueWindow();
+	void RunSamples(int t);
+	void PlanSourceMemory(int i);
+	void Prepare(int i);
+	static void NotifyPrepared(SourceState& src);
+	cv::Mat LoadTile(int i, int area_index, cv::Point& offset);
+	void Render(int i, SampleJob& job, const cv::Mat& img, MipPyramid* pyramid, const cv::Point& offset,
+		cv::Mat& tran_img, cv::Mat& homography);
+	TransformPlan PlanSample(int i, const SampleJob& job, const cv::Size& img_size, const cv::Point& offset);
+	void LogSample(int i, const SampleJob& job, const TransformPlan& plan, const cv::Size& img_size, const cv::Point& offset);
+	void LogCachedSample(int i, const SampleJob& job);
+	void FinishSource(int i);
+
+	std::string output_folder_;
+	std::string output_file_;
+	AugmentationParams prm_;
+	int num_threads_;
+	bool sweep_;
+	std::vector<cv::Vec3d> poses_;
+	std::unique_ptr<SweepWarpCache> warp_cache_;
+	OutputCache cache_;
+	std::unique_ptr<Progress> progress_;
+	std::unique_ptr<PlanLogWriter> plan_log_;
+	MemoryBudget budget_;
+	OpenCVThreadScope opencv_threads_;
+
+	// Images and tasks of all batches. Images and their tasks are dropped from the front when their annotation lines are written.
+	std::deque<SourceState> sources_;
+	int first_source_;			// index of sources_.front()
+	std::atomic<int> num_sources_;
+	std::deque<SampleTask> tasks_;
+	int first_task_;			// index of tasks_.front()
+	std::mutex queue_mutex_;	// guards sources_, tasks_ and window (elements of queues are referred without it)
+	std::condition_variable state_changed_;		// images are written, window is queued, or a task failed
+	std::atomic<long long> pending_tasks_;
+	std::atomic<long long> unprepared_;
+
+	// Images are fed to the pool by windows, planned by a task for each image
+	int window_;				// number of images of window
+	int next_feed_;				// first image not fed
+	bool window_open_;			// window is being planned
+	int window_begin_, window_end_;
+	int unplanned_;				// images of window not planned yet
+	bool failed_;				// a task threw an exception
+
+	std::mutex write_mutex_;
+	int num_finished_;
+	int next_write_;
+
+	// Declared last, so that threads are stopped before the other members are destroyed
+	std::unique_ptr<TaskPool> pool_;
+};
+
+
+AugmentationPipeline::AugmentationPipeline(const std::string& output_folder, const std::string& output_file, const AugmentationParams& params) :
+	output_folder_(output_folder), output_file_(output_file), prm_(params), num_threads_(ResolveNumThreads(params.num_threads)),
+	sweep_(!(params.yaw_sweep.empty() && params.pitch_sweep.empty() && params.roll_sweep.empty())),
+	cache_(params.cache_folder, (boost::filesystem::path(output_folder) / boost::filesystem::path("cache_manifest.txt")).string()),
+	budget_(TaskBudgetBytes(params, sweep_)), opencv_threads_(num_threads_),
+	first_source_(0), num_sources_(0), first_task_(0), pending_tasks_(0), unprepared_(0),
+	next_feed_(0), window_open_(false), window_begin_(0), window_end_(0), unplanned_(0), failed_(false),
+	num_finished_(0), next_write_(0)
+{
+	// Sweep mode renders every pose in grid instead of random rotation
+	if (sweep_){
+		poses_ = PoseGrid(prm_.yaw_sweep, prm_.pitch_sweep, prm_.roll_sweep);
+		prm_.num_generate = poses_.size();
+		prm_.yaw_sigma = prm_.pitch_sigma = prm_.roll_sigma = 0;
+		prm_.x_slide_sigma = prm_.y_slide_sigma = prm_.aspect_sigma = 0;
+	}
+	long long budget_bytes = (long long)prm_.memory_budget_mb * 1024 * 1024;
+	warp_cache_.reset(new SweepWarpCache(poses_, prm_.output_size,
+		(budget_bytes > 0) ? budget_bytes - TaskBudgetBytes(prm_, true) : MAX_SWEEP_CACHE_BYTES));
+
+	// Total is added by each batch
+	progress_.reset(new Progress(0, prm_.stats_file, !prm_.verbose, num_threads_));
+
+	if (!prm_.plan_log.empty()){
+		PlanLogHeader header;
+		header.render_version = CACHE_VERSION;
+		header.whole_image = prm_.whole_image;
+		header.sweep = sweep_;
+		header.load_unchanged = prm_.load_unchanged;
+		header.min_visible_ratio = prm_.min_visible_ratio;
+		plan_log_.reset(new PlanLogWriter(prm_.plan_log, header));
+		if (!plan_log_->IsOpen()){
+			Log("Fail to open " + prm_.plan_log, true);
+			plan_log_.reset();
+		}
+	}
+
+	window_ = num_threads_ * SOURCES_PER_THREAD;
+	pool_.reset(new TaskPool(num_threads_, *this));
+}
+
+
+SourceState& AugmentationPipeline::Source(int i)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex_);
+	return sources_[i - first_source_];
+}
+
+
+SampleTask AugmentationPipeline::Task(int t)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex_);
+	return tasks_[t - first_task_];
+}
+
+
+void AugmentationPipeline::Add(const std::vector<std::string>& img_files, const std::vector<std::vector<cv::Rect>>& areas)
+{
+	assert(areas.empty() || areas.size() == img_files.size());
+
+	for (int i = 0; i < img_files.size(); i++){
+		{
+			// Caller waits while many images are not written yet, so that images and their samples are not piled up
+			std::unique_lock<std::mutex> lock(queue_mutex_);
+			while (!failed_ && num_sources_ - first_source_ >= window_ * MAX_UNWRITTEN_WINDOWS){
+				lock.unlock();
+				Feed();
+				lock.lock();
+				if (!failed_ && num_sources_ - first_source_ >= window_ * MAX_UNWRITTEN_WINDOWS)
+					state_changed_.wait(lock);
+			}
+			if (failed_)
+				break;
+
+			sources_.emplace_back();
+			SourceState& src = sources_.back();
+			src.file = img_files[i];
+			if (!areas.empty())
+				src.obj_rects = areas[i];
+			src.num_areas = (prm_.whole_image || areas.empty()) ? 1 : areas[i].size();
+			src.has_areas = !areas.empty();
+			num_sources_++;
+		}
+		if ((i + 1) % window_ == 0)
+			Feed();
+	}
+	Feed();
+}
+
+
+void AugmentationPipeline::Finish()
+{
+	// All images are fed before the pool is closed
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex_);
+		while (!failed_ && (next_feed_ < num_sources_ || window_open_)){
+			lock.unlock();
+			Feed();
+			lock.lock();
+			if (!failed_ && (next_feed_ < num_sources_ || window_open_))
+				state_changed_.wait(lock);
+		}
+	}
+	pool_->Finish();
+}
+
+
+// Queue the next window of images when the tasks of the previous windows are planned and almost all started.
+// Samples are run largest first within a window, so that a small image is not overtaken by large images after it
+// and annotation lines are written while the pipeline runs. Each image is planned by a task (size of file and image).
+void AugmentationPipeline::Feed()
+{
+	int begin, end;
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+		if (failed_ || window_open_ || pending_tasks_ >= num_threads_ || next_feed_ >= num_sources_)
+			return;
+		begin = next_feed_;
+		end = std::min(next_feed_ + window_, (int)num_sources_);
+		next_feed_ = end;
+		window_open_ = true;
+		window_begin_ = begin;
+		window_end_ = end;
+		unplanned_ = end - begin;
+	}
+	for (int i = begin; i < end; i++){
+		pool_->Add(PlanTaskId(i), std::numeric_limits<double>::infinity());
+	}
+}
+
+
+// Estimate costs and memory of samples of image. The last image planned in a window queues the tasks of the window.
+void AugmentationPipeline::PlanSource(int i)
+{
+	SourceState& src = Source(i);
+	bool rotate = sweep_ || prm_.yaw_sigma > 0 || prm_.pitch_sigma > 0 || prm_.roll_sigma > 0;
+
+	// Image without objects generates nothing unless whole image is transformed
+	if (!src.has_areas || !src.obj_rects.empty() || prm_.whole_image){
+		long long bytes = FileBytes(src.file);
+		src.load_cost = bytes * PIXELS_PER_BYTE;
+
+		cv::Size img_size;
+		for (int j = 0; j < src.num_areas; j++){
+			cv::Size area_size;
+			if (!prm_.whole_image && src.has_areas){
+				area_size = src.obj_rects[j].size();
+			}
+			// Whole image (or empty area) needs size of image, which is not needed with output size
+			if (area_size.area() <= 0 && prm_.output_size.area() <= 0){
+				if (img_size.area() <= 0)
+					img_size = GuessImageSize(src.file, bytes);
+				area_size = img_size;
+			}
+			src.sample_costs.insert(src.sample_costs.end(), prm_.num_generate, SampleCost(area_size, prm_, rotate));
+			src.sample_bytes.insert(src.sample_bytes.end(), prm_.num_generate, SampleBytes(area_size, prm_, rotate));
+		}
+		if (budget_.Enabled())
+			PlanSourceMemory(i);
+	}
+
+	bool last;
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+		last = (--unplanned_ == 0);
+	}
+	if (last)
+		QueueWindow();
+}
+
+
+// Split samples of images of window into tasks and queue them. Loading is counted in the first task of image.
+// With memory budget, tasks of image are given the cost of the whole image, so that they run one after another
+// and few images are kept loaded at the same time.
+void AugmentationPipeline::QueueWindow()
+{
+	int begin = window_begin_, end = window_end_;
+	double total_cost = 0;
+	for (int i = begin; i < end; i++){
+		SourceState& src = Source(i);
+		total_cost += src.sample_costs.empty() ? 0 : src.load_cost;
+		for (int n = 0; n < src.sample_costs.size(); n++){
+			total_cost += src.sample_costs[n];
+		}
+	}
+
+	double task_cost = total_cost / (num_threads_ * TASKS_PER_THREAD);
+	std::vector<SampleTask> tasks;
+	std::vector<double> costs;
+	long long num_samples = 0;
+	for (int i = begin; i < end; i++){
+		SourceState& src = Source(i);
+		int num_jobs = src.sample_costs.size();
+		if (num_jobs == 0)
+			continue;
+
+		double cost = src.load_cost;
+		for (int n = 0; n < num_jobs; n++){
+			cost += src.sample_costs[n];
+		}
+		int num_tasks = (task_cost > 0) ? std::min(std::max(cvCeil(cost / task_cost), 1), num_jobs) : 1;
+		for (int t = 0; t < num_tasks; t++){
+			SampleTask task;
+			task.source = i;
+			task.begin = (long long)num_jobs * t / num_tasks;
+			task.end = (long long)num_jobs * (t + 1) / num_tasks;
+			double sum = (t == 0) ? src.load_cost : 0;
+			long long max_bytes = 0;
+			for (int n = task.begin; n < task.end; n++){
+				sum += src.sample_costs[n];
+				max_bytes = std::max(max_bytes, src.sample_bytes[n]);
+			}
+			task.bytes = max_bytes;
+			tasks.push_back(task);
+			costs.push_back(budget_.Enabled() ? cost : sum);
+		}
+		src.remaining_tasks = num_tasks;
+		num_samples += num_jobs;
+		unprepared_++;
+	}
+	pending_tasks_ += tasks.size();
+
+	int first_task;
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+		first_task = first_task_ + tasks_.size();
+		tasks_.insert(tasks_.end(), tasks.begin(), tasks.end());
+	}
+
+	progress_->AddTotal(num_samples);
+	for (int i = begin; i < end; i++){
+		if (Source(i).sample_costs.empty())
+			FinishSource(i);
+	}
+	for (int t = 0; t < tasks.size(); t++){
+		pool_->Add(first_task + t, costs[t]);
+	}
+
+	// The next window can be fed
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
+		window_open_ = false;
+	}
+	state_changed_.notify_all();
+	Feed();
+}
+
+
+void AugmentationPipeline::operator()(int t)
+{
+	// Callers waiting for images to be written are released if a task fails
+	try{
+		if (t < 0)
+			PlanSource(-1 - t);
+		else
+			RunSamples(t);
+	}
+	catch (...){
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex_);
+			failed_ = true;
+		}
+		state_changed_.notify_all();
+		throw;
+	}
+}
+
+
+void AugmentationPipeline::RunSamples(int t)
+{
+	SampleTask task = Task(t);
+	SourceState& src = Source(task.source);
+
+	// The first task of image prepares it, and the others wait for it before they count their memory,
+	// so that the task which loads the image is always the one which counts it
+	bool first = !src.claimed.exchange(true);
+	if (!first){
+		std::unique_lock<std::mutex> lock(src.prepare_mutex);
+		while (!src.prepared)
+			src.prepare_cond.wait(lock);
+	}
+
+	// Task waits while memory budget is full. The first task of image also counts the loaded image,
+	// which is kept until the last task releases it. Tiles are counted by every task.
+	bool charge = first && !src.tiled;
+	long long bytes = task.bytes + ((src.tiled || charge) ? src.bytes : 0);
+	MemoryBudget::Task budget_task(budget_, bytes, charge ? src.bytes : 0);
+	progress_->SetQueueDepth(Progress::STAGE_RENDER, --pending_tasks_);
+	Feed();
+
+	if (first){
+		src.charged = charge;
+		try{
+			Prepare(task.source);
+		}
+		catch (...){
+			NotifyPrepared(src);
+			throw;
+		}
+		NotifyPrepared(src);
+	}
+
+	// Output buffer is reused among samples of task
+	cv::Mat tran_img, homography;
+
+	// Tile of area of tiled image, reused while samples are of the same area.
+	// Its mip levels are built from larger regions loaded by the loader, so that they are the same as those of whole image.
+	SourceRegionLoader loader(src.file, prm_, src.load);
+	cv::Mat tile;
+	std::unique_ptr<MipPyramid> tile_pyramid;
+	cv::Point tile_offset;
+	int tile_area = -1;
+
+	int end = std::min(task.end, (int)src.jobs.size());
+	for (int n = task.begin; n < end; n++){
+		SampleJob& job = src.jobs[n];
+		if (job.cached){
+			progress_->AddCached();
+			if (prm_.verbose)
+				Log("Cached image " + job.dst_file, false);
+			if (plan_log_ && src.planned)
+				LogCachedSample(task.source, job);
+		}
+		else if (src.ok && src.tiled){
+			if (job.area_index != tile_area){
+				tile_area = job.area_index;
+				tile_pyramid.reset();
+				tile = LoadTile(task.source, tile_area, tile_offset);
+				if (!tile.empty())
+					tile_pyramid.reset(new MipPyramid(tile, tile_offset, src.load.rect.size(), &loader));
+			}
+			if (tile.empty())
+				progress_->AddFailed();
+			else
+				Render(task.source, job, tile, tile_pyramid.get(), tile_offset, tran_img, homography);
+		}
+		else if (src.ok){
+			Render(task.source, job, src.img, src.pyramid.get(), cv::Point(), tran_img, homography);
+		}
+	}
+
+	// The last task of image releases it
+	if (--src.remaining_tasks == 0){
+		src.img.release();
+		src.pyramid.reset();
+		if (src.charged)
+			budget_.Release(src.bytes);
+		FinishSource(task.source);
+	}
+}
+
+
+// Estimate bytes of image counted in memory budget before loading it.
+// Image which exceeds the budget alone is tiled if its areas can be loaded separately
+// (JPEG decoded by region without random deformation of areas). Without region decoding, each tile would decode whole image.
+void AugmentationPipeline::PlanSourceMemory(int i)
+{
+	SourceState& src = Source(i);
+	const std::string& file = src.file;
+	const std::vector<cv::Rect>& obj_rects = src.obj_rects;
+
+	SourceLoad load = PlanSourceLoad(file, obj_rects, prm_);
+	cv::Size img_size = load.region ? load.rect.size() : GuessImageSize(file, FileBytes(file));
+	src.bytes = SourceBytes(img_size, prm_);
+	if (!budget_.Exceeds(src.bytes) || !load.region || !CanDecodeRegion() || prm_.whole_image || obj_rects.empty() ||
+		prm_.x_slide_sigma != 0 || prm_.y_slide_sigma != 0 || prm_.aspect_sigma != 0)
+		return;
+
+	long long tile_bytes = 0;
+	for (int j = 0; j < obj_rects.size(); j++){
+		cv::Rect tile = AreaTile(load.rect.size(), ReduceRect(obj_rects[j], load.reduction) - load.rect.tl());
+		tile_bytes = std::max(tile_bytes, SourceBytes(tile.size(), prm_));
+	}
+	src.tiled = true;
+	src.bytes = tile_bytes;
+}
+
+
+// Look up cache for all samples of image, and load it unless all of them are cached
+void AugmentationPipeline::Prepare(int i)
+{
+	using namespace boost::filesystem;
+
+	SourceState& src = Source(i);
+	const std::string& file = src.file;
+	progress_->SetQueueDepth(Progress::STAGE_LOAD, --unprepared_);
+
+	int num_area = src.num_areas;
+	long long src_bytes = FileBytes(file);
+	bool bytes_counted = false;
+
+	// Content of image is hashed only for cache keys and plan log, and it is read only if the cache has no hash of it
+	unsigned long long content_hash = 0;
+	if (cache_.Enabled() || plan_log_){
+		bool hashed, read;
+		{
+			Progress::Scope scope(*progress_, Progress::STAGE_LOAD);
+			hashed = cache_.HashSource(file, content_hash, read);
+		}
+		if (!hashed){
+			Log("Fail to read " + file, true);
+			progress_->AddFailed(num_area * prm_.num_generate);
+			return;
+		}
+		if (read){
+			progress_->AddBytesRead(src_bytes);
+			bytes_counted = true;
+		}
+	}
+
+	const std::vector<cv::Rect>& obj_rects = src.obj_rects;
+	SourceLoad load = PlanSourceLoad(file, obj_rects, prm_);
+	std::string params_key = ParamsKey(prm_, load);
+
+	// Look up cache for all samples (whole image has one area)
+	int num_uncached = 0;
+	for (int j = 0; j < num_area; j++){
+		for (int k = 0; k < prm_.num_generate; k++){
+			SampleJob job;
+			job.area_index = j;
+			job.sample_index = k;
+
+			std::vector<cv::Rect> seed_rects;
+			if (prm_.whole_image){
+				seed_rects = obj_rects;
+			}
+			else if (!obj_rects.empty()){
+				seed_rects.push_back(obj_rects[j]);
+			}
+			job.seed = SampleSeed(prm_.seed, file, seed_rects, k);
+			job.key = SampleCacheKey(job.seed, content_hash, params_key);
+
+			job.dst_file = (path(output_folder_) / path(SampleName(i, j, k, prm_.whole_image) + ".png")).string();
+
+			{
+				Progress::Scope scope(*progress_, Progress::STAGE_WRITE);
+				job.cached = cache_.Fetch(job.key, job.dst_file, job.dst_rects, job.tag);
+			}
+			job.saved = job.cached;
+			if (!job.cached)
+				num_uncached++;
+			src.jobs.push_back(job);
+		}
+	}
+
+	// Image is not decoded if all samples are cached.
+	// Plan log needs the size of loaded image for the plans of cached samples, which is known without decoding only for JPEG.
+	bool decode = (num_uncached > 0 || (plan_log_ && load.rect.area() == 0));
+	if (!decode && !plan_log_){
+		src.ok = true;
+		return;
+	}
+
+	// Tiled image is loaded by area in LoadTile()
+	if (decode && !src.tiled){
+		if (prm_.verbose)
+			Log("Load " + file, false);
+		{
+			Progress::Scope scope(*progress_, Progress::STAGE_LOAD);
+			src.img = LoadSourceImage(file, prm_, load);
+		}
+		if (src.img.empty() || !IsSupportedImageType(src.img.type())){
+			Log((src.img.empty() ? "Fail to load " : "Unsupported image type: ") + file, true);
+			src.img.release();
+			progress_->AddFailed(num_uncached);
+			return;
+		}
+	}
+	src.load = load;
+
+	// Source is counted once even if it is read for hash and decoded, or loaded by tile
+	if (!bytes_counted && (!src.img.empty() || (src.tiled && num_uncached > 0)))
+		progress_->AddBytesRead(src_bytes);
+	src.img_size = src.img.empty() ? load.rect.size() : src.img.size();
+
+	// Annotated rectangles on loaded image
+	for (int j = 0; j < obj_rects.size(); j++){
+		src.img_areas.push_back(ReduceRect(obj_rects[j], load.reduction) - load.rect.tl());
+	}
+	src.planned = true;
+
+	// Mip levels are built when a sample needs them, and shared among samples of the image
+	if (!src.img.empty())
+		src.pyramid.reset(new MipPyramid(src.img));
+	src.ok = true;
+
+	if (plan_log_){
+		PlanLogSource log_source;
+		log_source.index = i;
+		log_source.file = file;
+		log_source.content_hash = content_hash;
+		log_source.load = load;
+		log_source.rects = src.img_areas;
+		plan_log_->AddSource(log_source);
+	}
+}
+
+
+// Wake the tasks of image waiting for its preparation
+void AugmentationPipeline::NotifyPrepared(SourceState& src)
+{
+	{
+		std::lock_guard<std::mutex> lock(src.prepare_mutex);
+		src.prepared = true;
+	}
+	src.prepare_cond.notify_all();
+}
+
+
+// Load tile of area of tiled image. offset is the position of tile on loaded image.
+cv::Mat AugmentationPipeline::LoadTile(int i, int area_index, cv::Point& offset)
+{
+	SourceState& src = Source(i);
+	const std::string& file = src.file;
+
+	cv::Rect tile = AreaTile(src.load.rect.size(), src.img_areas[area_index]);
+	SourceLoad load = src.load;
+	load.rect = tile + src.load.rect.tl();
+	offset = tile.tl();
+
+	if (prm_.verbose)
+		Log("Load tile " + file, false);
+	cv::Mat img;
+	{
+		Progress::Scope scope(*progress_, Progress::STAGE_LOAD);
+		img = LoadSourceImage(file, prm_, load);
+	}
+	if (img.empty())
+		Log("Fail to load " + file, true);
+	return img;
+}
+
+
+// Render sample from img, which is the loaded image or its tile at offset
+void AugmentationPipeline::Render(int i, SampleJob& job, const cv::Mat& img, MipPyramid* pyramid, const cv::Point& offset,
+	cv::Mat& tran_img, cv::Mat& homography)
+{
+	SourceState& src = Source(i);
+
+	{
+		Progress::Scope scope(*progress_, Progress::STAGE_RENDER);
+		TransformPlan plan = PlanSample(i, job, img.size(), offset);
+		RotationWarp warp;
+		if (sweep_)
+			warp = warp_cache_->GetWarp(img.size(), plan.rect, job.sample_index);
+		ExecuteTransformPlan(img, plan, tran_img, homography, sweep_ ? &warp : NULL, pyramid);
+
+		if (plan_log_)
+			LogSample(i, job, plan, img.size(), offset);
+
+		if (prm_.whole_image){
+			TransformObjectRects(src.img_areas, plan, homography, tran_img.size(), prm_.min_visible_ratio, job.dst_rects);
+		}
+		else{
+			job.dst_rects.push_back(cv::Rect(0, 0, tran_img.cols, tran_img.rows));
+		}
+		job.tag = sweep_ ? PoseTag(plan) : "";
+	}
+
+	Progress::Scope scope(*progress_, Progress::STAGE_WRITE);
+	UnlinkOutputFile(job.dst_file);
+	if (cv::imwrite(job.dst_file, tran_img)){
+		cache_.Store(job.key, job.dst_file, job.dst_rects, job.tag);
+		job.saved = true;
+		progress_->AddDone();
+		progress_->AddBytesWritten(FileBytes(job.dst_file));
+		if (prm_.verbose)
+			Log("Save image " + job.dst_file + "...succeed", false);
+	}
+	else{
+		progress_->AddFailed();
+		Log("Save image " + job.dst_file + "...fail", true);
+	}
+}
+
+
+// Draw plan of sample on img_size, which is the size of the loaded image or its tile at offset
+TransformPlan AugmentationPipeline::PlanSample(int i, const SampleJob& job, const cv::Size& img_size, const cv::Point& offset)
+{
+	SourceState& src = Source(i);
+
+	// Transform whole image and all rectangles together, or each area
+	cv::Rect area;
+	if (!prm_.whole_image){
+		area = src.img_areas.empty() ? cv::Rect(0, 0, img_size.width, img_size.height) : src.img_areas[job.area_index] - offset;
+	}
+
+	cv::RNG rng(job.seed);
+	int k = job.sample_index;
+	TransformPlan plan = PlanImageTransform(img_size, area, prm_, rng);
+	if (sweep_){
+		plan.yaw = poses_[k][0], plan.pitch = poses_[k][1], plan.roll = poses_[k][2];
+		plan.rotate = (plan.yaw != 0 || plan.pitch != 0 || plan.roll != 0);
+	}
+	return plan;
+}
+
+
+void AugmentationPipeline::LogSample(int i, const SampleJob& job, const TransformPlan& plan, const cv::Size& img_size,
+	const cv::Point& offset)
+{
+	PlanLogSample log_sample;
+	log_sample.source = i;
+	log_sample.area_index = job.area_index;
+	log_sample.sample_index = job.sample_index;
+	log_sample.plan = plan;
+	log_sample.plan.rect = plan.rect + offset;		// on loaded image
+	log_sample.tile = Source(i).tiled ? cv::Rect(offset.x, offset.y, img_size.width, img_size.height) : cv::Rect();
+	plan_log_->AddSample(log_sample);
+}
+
+
+// Plan of cached sample is drawn again as it was rendered, on the tile which would be loaded for it
+void AugmentationPipeline::LogCachedSample(int i, const SampleJob& job)
+{
+	SourceState& src = Source(i);
+	cv::Size img_size = src.img_size;
+	cv::Point offset;
+	if (src.tiled){
+		cv::Rect tile = AreaTile(src.img_size, src.img_areas[job.area_index]);
+		img_size = tile.size();
+		offset = tile.tl();
+	}
+	LogSample(i, job, PlanSample(i, job, img_size, offset), img_size, offset);
+}
+
+
+// Annotation lines are written in the order of input images, while images are finished in any order
+void AugmentationPipeline::FinishSource(int i)
+{
+	std::lock_guard<std::mutex> lock(write_mutex_);
+	Source(i).finished = true;
+	num_finished_++;
+	while (next_write_ < num_sources_ && Source(next_write_).finished){
+		std::vector<SampleJob>& jobs = Source(next_write_).jobs;
+		for (int n = 0; n < jobs.size(); n++){
+			if (jobs[n].saved)
+				util::AddAnnotationLine(output_file_, jobs[n].dst_file, jobs[n].dst_rects, " ", jobs[n].tag);
+		}
+		next_write_++;
+	}
+
+	// Written images and their tasks are not referred any more
+	{
+		std::lock_guard<std::mutex> queue_lock(queue_mutex_);
+		while (first_source_ < next_write_){
+			sources_.pop_front();
+			first_source_++;
+		}
+		while (!tasks_.empty() && tasks_.front().source < first_source_){
+			tasks_.pop_front();
+			first_task_++;
+		}
+	}
+	state_changed_.notify_all();
+	progress_->SetQueueDepth(Progress::STAGE_WRITE, num_finished_ - next_write_);
+}
+
+
+void DataAugmentation(const std::vector<std::string>& img_files, const std::vector<std::vector<cv::Rect>>& areas,
+	const std::string& output_folder, const std::string& output_file, const AugmentationParams& params)
+{
+	AugmentationPipeline pipeline(output_folder, output_file, params);
+	pipeline.Add(img_files, areas);
+	pipeline.Finish();
+}
+
+
+// Maximum number of images found by scanner and added together
+const int MAX_SCAN_BATCH = 4096;
+
+
+void DataAugmentation(ImageFileScanner& scanner, const std::string& output_folder, const std::string& output_file,
+	const AugmentationParams& params)
+{
+	AugmentationPipeline pipeline(output_folder, output_file, params);
+
+	// Images found so far are queued while the scanner continues, and threads take them as soon as they are free
+	std::vector<std::string> img_files;
+	while (scanner.NextBatch(img_files, MAX_SCAN_BATCH)){
+		pipeline.Add(img_files, std::vector<std::vector<cv::Rect>>());
+	}
+	pipeline.Finish();
+}
+
+
+// Orders logged samples by image, area, and sample index
+struct LoggedSampleOrder
+{
+	explicit LoggedSampleOrder(const std::vector<PlanLogSample>& samples) : samples_(samples){}
+
+	bool operator()(int a, int b) const
+	{
+		const PlanLogSample& sa = samples_[a];
+		const PlanLogSample& sb = samples_[b];
+		if (sa.source != sb.source)
+			return sa.source < sb.source;
+		if (sa.area_index != sb.area_index)
+			return sa.area_index < sb.area_index;
+		return sa.sample_index < sb.sample_index;
+	}
+
+	const std::vector<PlanLogSample>& samples_;
+};
+
+
+// Replay of logged samples. Each task loads one image and renders its selected samples.
+class PlanReplay : public TaskBody
+{
+public:
+	PlanReplay(const PlanLogHeader& header, const std::vector<PlanLogSource>& sources, const std::vector<PlanLogSample>& samples,
+		const std::vector<int>& selected, const std::string& output_folder, const AugmentationParams& params);
+
+	void Run();
+
+	void operator()(int t);
+
+	//! Add annotation lines of rendered images in order of samples
+	void WriteAnnotation(const std::string& output_file) const;
+
+private:
+	// Output of selected sample
+	struct Result
+	{
+		std::string dst_file;
+		bool saved;
+		std::vector<cv::Rect> dst_rects;
+		std::string tag;
+	};
+
+	const PlanLogHeader& header_;
+	const std::vector<PlanLogSource>& sources_;
+	const std::vector<PlanLogSample>& samples_;
+	const std::vector<int>& selected_;
+	AugmentationParams params_;
+	std::map<int, int> source_pos_;		// index of image to position in sources_
+	std::vector<int> task_begin_;		// first position in selected_ of each task
+	std::vector<Result> results_;		// result of each selected sample
+	std::unique_ptr<Progress> progress_;
+};
+
+
+PlanReplay::PlanReplay(const PlanLogHeader& header, const std::vector<PlanLogSource>& sources, const std::vector<PlanLogSample>& samples,
+	const std::vector<int>& selected, const std::string& output_folder, const AugmentationParams& params) :
+	header_(header), sources_(sources), samples_(samples), selected_(selected), params_(params), results_(selected.size())
+{
+	// Images are loaded in the same way as the logged run
+	params_.load_unchanged = header.load_unchanged;
+
+	for (int s = 0; s < sources_.size(); s++){
+		source_pos_[sources_[s].index] = s;
+	}
+	for (int n = 0; n < selected_.size(); n++){
+		const PlanLogSample& sample = samples_[selected_[n]];
+		std::string name = SampleName(sample.source, sample.area_index, sample.sample_index, header_.whole_image);
+		results_[n].dst_file = (boost::filesystem::path(output_folder) / boost::filesystem::path(name + ".png")).string();
+		results_[n].saved = false;
+	}
+}
+
+
+void PlanReplay::Run()
+{
+	// One task for each image, which costs loading it and rendering its samples (selected_ is sorted by image)
+	std::vector<double> costs;
+	for (int n = 0; n < selected_.size(); n++){
+		const PlanLogSample& sample = samples_[selected_[n]];
+		if (n == 0 || sample.source != samples_[selected_[n - 1]].source){
+			task_begin_.push_back(n);
+			costs.push_back(FileBytes(sources_[source_pos_[sample.source]].file) * PIXELS_PER_BYTE);
+		}
+		const TransformPlan& plan = sample.plan;
+		double pixels = (plan.output_size.area() > 0) ? plan.output_size.area() : (double)plan.rect.area();
+		costs.back() += plan.rotate ? pixels * ROTATION_COST : pixels;
+	}
+	task_begin_.push_back(selected_.size());
+
+	int num_threads = ResolveNumThreads(params_.num_threads);
+	progress_.reset(new Progress(selected_.size(), params_.stats_file, !params_.verbose, num_threads));
+	{
+		OpenCVThreadScope opencv_threads(num_threads);
+		RunTasksByCost(costs, num_threads, *this);
+	}
+
+	// Final report
+	progress_.reset();
+}
+
+
+void PlanReplay::operator()(int t)
+{
+	int begin = task_begin_[t], end = task_begin_[t + 1];
+	const PlanLogSource& source = sources_[source_pos_.find(samples_[selected_[begin]].source)->second];
+
+	// Plans are valid only for the logged content of image
+	unsigned long long content_hash;
+	bool hashed;
+	{
+		Progress::Scope scope(*progress_, Progress::STAGE_LOAD);
+		hashed = util::HashFile(source.file, content_hash);
+	}
+	if (!hashed || content_hash != source.content_hash){
+		Log((!hashed ? "Fail to read " : "Image is changed after logging: ") + source.file, true);
+		progress_->AddFailed(end - begin);
+		return;
+	}
+	// Source is counted once here, not again when it is decoded
+	progress_->AddBytesRead(FileBytes(source.file));
+
+	// Loaded image, or tile of tiled image which is reloaded when the tile of sample changes.
+	// Samples are rendered from the same pixels and mip levels as the logged run.
+	SourceRegionLoader loader(source.file, params_, source.load);
+	cv::Mat img;
+	std::unique_ptr<MipPyramid> pyramid;
+	cv::Rect tile;
+	bool loaded = false;
+	cv::Mat tran_img, homography;
+	for (int n = begin; n < end; n++){
+		const PlanLogSample& sample = samples_[selected_[n]];
+		Result& result = results_[n];
+		if (!loaded || sample.tile != tile){
+			SourceLoad load = source.load;
+			if (sample.tile.area() > 0)
+				load.rect = sample.tile + source.load.rect.tl();
+			tile = sample.tile;
+			pyramid.reset();
+			{
+				Progress::Scope scope(*progress_, Progress::STAGE_LOAD);
+				img = LoadSourceImage(source.file, params_, load);
+			}
+			if (!img.empty() && IsSupportedImageType(img.type())){
+				if (tile.area() > 0)
+					pyramid.reset(new MipPyramid(img, tile.tl(), source.load.rect.size(), &loader));
+				else
+					pyramid.reset(new MipPyramid(img));
+				if (params_.verbose)
+					Log(((tile.area() > 0) ? "Load tile " : "Load ") + source.file, false);
+			}
+			else{
+				Log("Fail to load " + source.file, true);
+			}
+			loaded = true;
+		}
+		if (!pyramid){
+			progress_->AddFailed();
+			continue;
+		}
+
+		TransformPlan plan = sample.plan;
+		plan.rect = plan.rect - tile.tl();		// on img
+		{
+			Progress::Scope scope(*progress_, Progress::STAGE_RENDER);
+
+			// Sweep warp is computed in the same way as SweepWarpCache
+			RotationWarp warp;
+			bool sweep_warp = (header_.sweep && plan.rotate);
+			if (sweep_warp){
+				PrepareRotationWarp(RotationSourceRect(img.size(), plan.rect).size(), plan.rect.size(),
+					plan.yaw, plan.pitch, plan.roll, warp, true, 1000, plan.output_size);
+			}
+			ExecuteTransformPlan(img, plan, tran_img, homography, sweep_warp ? &warp : NULL, pyramid.get());
+
+			if (header_.whole_image){
+				TransformObjectRects(source.rects, plan, homography, tran_img.size(), header_.min_visible_ratio, result.dst_rects);
+			}
+			else{
+				result.dst_rects.push_back(cv::Rect(0, 0, tran_img.cols, tran_img.rows));
+			}
+			result.tag = header_.sweep ? PoseTag(plan) : "";
+		}
+
+		Progress::Scope scope(*progress_, Progress::STAGE_WRITE);
+		UnlinkOutputFile(result.dst_file);
+		if (cv::imwrite(result.dst_file, tran_img)){
+			result.saved = true;
+			progress_->AddDone();
+			progress_->AddBytesWritten(FileBytes(result.dst_file));
+			if (params_.verbose)
+				Log("Save image " + result.dst_file + "...succeed", false);
+		}
+		else{
+			progress_->AddFailed();
+			Log("Save image " + result.dst_file + "...fail", true);
+		}
+	}
+}
+
+
+void PlanReplay::WriteAnnotation(const std::string& output_file) const
+{
+	for (int n = 0; n < results_.size(); n++){
+		if (results_[n].saved)
+			util::AddAnnotationLine(output_file, results_[n].dst_file, results_[n].dst_rects, " ", results_[n].tag);
+	}
+}
+
+
+bool ReplayTransformPlans(const std::string& log_file, const std::string& output_folder, const std::string& output_file,
+	const AugmentationParams& params)
+{
+	PlanLogHeader header;
+	std::vector<PlanLogSource> sources;
+	std::vector<PlanLogSample> samples;
+	if (!ReadPlanLog(log_file, header, sources, samples))
+		return false;
+
+	// Another version of rendering does not reproduce the logged images
+	if (header.render_version != CACHE_VERSION){
+		std::cout << "Plan log is written by another version of rendering (" << header.render_version
+			<< ", current " << CACHE_VERSION << ")" << std::endl;
+		return false;
+	}
+
+	// Samples of logged images selected by names of output images
+	std::set<int> logged_sources;
+	for (int s = 0; s < sources.size(); s++){
+		logged_sources.insert(sources[s].index);
+	}
+	std::set<std::string> ids(params.replay_ids.begin(), params.replay_ids.end());
+	std::set<std::string> found_ids;
+	std::vector<int> selected;
+	for (int n = 0; n < samples.size(); n++){
+		std::string name = SampleName(samples[n].source, samples[n].area_index, samples[n].sample_index, header.whole_image);
+		if (!logged_sources.count(samples[n].source) || (!ids.empty() && !ids.count(name)) || found_ids.count(name))
+			continue;
+		found_ids.insert(name);
+		selected.push_back(n);
+	}
+	for (std::set<std::string>::const_iterator it = ids.begin(); it != ids.end(); it++){
+		if (!found_ids.count(*it))
+			std::cout << "Sample is not found in plan log: " << *it << std::endl;
+	}
+	std::sort(selected.begin(), selected.end(), LoggedSampleOrder(samples));
+
+	PlanReplay replay(header, sources, samples, selected, output_folder, params);
+	replay.Run();
+	replay.WriteAnnotation(output_file);
+	return true;
 }
@@ -35,19 +35,177 @@
 #define __DATA_AUGMENTATION__
 
 #include <opencv2/core/core.hpp>
+#include <ostream>
+#include <string>
 
+struct RotationWarp;
+class MipPyramid;
+class ImageFileScanner;
+
+//! Parameters of data augmentation (same entries as configuration file)
+struct AugmentationParams
+{
+	AugmentationParams();
+
+	int num_generate;			//!< number of images generated from one input
+	double yaw_sigma;			//!< sigma of yaw angle (degree)
+	double pitch_sigma;			//!< sigma of pitch angle (degree)
+	double roll_sigma;			//!< sigma of roll angle (degree)
+	double blur_max_sigma;		//!< maximum sigma of Gaussian blur (pixel)
+	double noise_max_sigma;		//!< maximum sigma of Gaussian noise (pixel value)
+	double x_slide_sigma;		//!< sigma of slide in x direction (ratio of width)
+	double y_slide_sigma;		//!< sigma of slide in y direction (ratio of height)
+	double aspect_sigma;		//!< sigma of aspect ratio change
+	double hflip_ratio;			//!< probability of horizontal flip
+	double vflip_ratio;			//!< probability of vertical flip
+	double brightness_sigma;	//!< sigma of brightness shift (pixel value)
+	double contrast_sigma;		//!< sigma of contrast change (ratio)
+	double gamma_sigma;			//!< sigma of gamma in log scale
+	double hue_sigma;			//!< sigma of hue rotation (degree)
+	double saturation_sigma;	//!< sigma of saturation change (ratio)
+	bool whole_image;			//!< transform whole image and all rectangles together
+	double min_visible_ratio;	//!< minimum visible area ratio to keep transformed rectangle
+	bool load_unchanged;		//!< load images with alpha channel and 16 bit depth as they are
+	cv::Size output_size;		//!< size of output image (empty: size of area)
+	unsigned int seed;			//!< seed of random numbers. Each sample is seeded by it, content of image, area, and index.
+	std::string cache_folder;	//!< folder of output cache (empty: no cache)
+	bool verbose;				//!< log every file instead of progress line
+	std::string stats_file;		//!< JSON file of progress statistics (empty: not written)
+	int num_threads;			//!< number of threads of DataAugmentation() (0: number of hardware threads)
+	int memory_budget_mb;		//!< budget of memory of images in flight in DataAugmentation() (MB, 0: unlimited)
+	std::string plan_log;		//!< binary log of parameters of every rendered sample (empty: not written)
+	std::vector<std::string> replay_ids;	//!< names of output images rendered by ReplayTransformPlans() (empty: all)
+	std::vector<double> yaw_sweep;		//!< yaw angles of sweep mode (empty: no sweep)
+	std::vector<double> pitch_sweep;	//!< pitch angles of sweep mode (empty: no sweep)
+	std::vector<double> roll_sweep;		//!< roll angles of sweep mode (empty: no sweep)
+};
+
+//! Parameters of image transformation drawn for one sample
+/*!
+All random parameters are drawn by PlanImageTransform() before execution.
+Stages which do not change the image are disabled so that ExecuteTransformPlan() skips them.
+*/
+struct TransformPlan
+{
+	cv::Rect rect;		//!< deformed area in input image
+	cv::Size output_size;	//!< size to which area is rendered (empty: size of area)
+	bool rotate;		//!< false if all angles are zero
+	double yaw, pitch, roll;
+	bool color;			//!< false if hue is zero and saturation is one
+	double hue, saturation;
+	bool lut;			//!< false if brightness is zero, and contrast and gamma are one
+	double brightness, contrast, gamma;
+	bool noise;			//!< false if sigma is too small to change pixel values
+	double noise_sigma;
+	unsigned int noise_seed;
+	bool blur;			//!< false if kernel size is smaller than 3
+	int blur_size;
+	double blur_sigma;
+	bool hflip, vflip;
+};
+
+//! Print enabled stages of plan for debugging
+std::ostream& operator<<(std::ostream& os, const TransformPlan& plan);
+
+//! Draw all random parameters of ImageTransform()
+/*!
+\param[in] img_size size of input image
+\param[in] area target area in input image. Whole image is used without deformation if area is empty.
+*/
+TransformPlan PlanImageTransform(const cv::Size& img_size, const cv::Rect& area, const AugmentationParams& params,
+	cv::RNG& rng);
+
+//! PlanImageTransform() with random numbers of cv::RNG()
+TransformPlan PlanImageTransform(const cv::Size& img_size, const cv::Rect& area, const AugmentationParams& params);
+
+//! Execute enabled stages of plan
+/*!
+dst is reused if it already has the output size and type.
+\param[in] img input image
+\param[in] plan transformation parameters
+\param[out] dst transformed image
+\param[out] homography 3x3 homography from img coordinates to dst coordinates before flip (CV_64FC1)
+\param[in] warp precomputed rotation maps for plan.rect, angles, and output size of plan (optional)
+\param[in,out] pyramid mip pyramid of img shared among samples (optional). Rotation samples its levels, and keeps the source shrunk by its prefilter in it.
+*/
+void ExecuteTransformPlan(const cv::Mat& img, const TransformPlan& plan, cv::Mat& dst, cv::Mat& homography,
+	const RotationWarp* warp = NULL, MipPyramid* pyramid = NULL);
+
+
+//! Transform area of image randomly
+/*!
+This function does not touch any global state, so it can be called from several threads with their own rng.
+\param[in] img input image (CV_8UC1, CV_8UC3, CV_8UC4, or CV_16UC1)
+\param[in] area target area in input image. Whole image is used if area is empty.
+\param[in] params parameters of transformation
+\param[out] drawn_plan drawn parameters (optional). ExecuteTransformPlan() with it renders the same image.
+\return transformed image which has the size of area (or params.output_size)
+*/
+cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area, const AugmentationParams& params,
+	cv::RNG& rng, TransformPlan* drawn_plan = NULL);
+
+//! ImageTransform() with random numbers of cv::RNG()
+cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area, const AugmentationParams& params);
+
+//! ImageTransform() with positional parameters (kept for compatibility)
 cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area, 
 	double yaw_range, double pitch_range, double roll_range,
 	double blur_sigma, double noise_sigma, double x_slide, double y_slide,
 	double aspect_range, double hflip_ratio, double vflip_ratio, 
-	cv::RNG& rng = cv::RNG());
+	cv::RNG& rng);
+
+cv::Mat ImageTransform(const cv::Mat& img, const cv::Rect& area, 
+	double yaw_range, double pitch_range, double roll_range,
+	double blur_sigma, double noise_sigma, double x_slide, double y_slide,
+	double aspect_range, double hflip_ratio, double vflip_ratio);
+
+
+//! Transform whole image and all rectangles on it together
+/*!
+Rectangles are transformed with the same homography as the image, clipped by the output image,
+and removed when the visible area is smaller than params.min_visible_ratio of the transformed area.
+\param[in] img input image
+\param[in] rects object rectangles on img
+\param[out] dst_rects object rectangles on output image
+\param[in] params parameters of transformation (slide and aspect ratio are not used)
+\param[out] drawn_plan drawn parameters (optional)
+\return transformed image
+*/
+cv::Mat ImageTransformWithRects(const cv::Mat& img, const std::vector<cv::Rect>& rects, std::vector<cv::Rect>& dst_rects,
+	const AugmentationParams& params, cv::RNG& rng, TransformPlan* drawn_plan = NULL);
+
+//! ImageTransformWithRects() with random numbers of cv::RNG()
+cv::Mat ImageTransformWithRects(const cv::Mat& img, const std::vector<cv::Rect>& rects, std::vector<cv::Rect>& dst_rects,
+	const AugmentationParams& params);
+
+//! Poses (yaw, pitch, roll) of sweep mode: all combinations of angles in params.yaw_sweep, pitch_sweep, and roll_sweep
+/*!
+Empty list means zero. No pose is returned if all lists are empty.
+*/
+std::vector<cv::Vec3d> SweepPoses(const AugmentationParams& params);
 
 
 void DataAugmentation(const std::vector<std::string>& img_files, const std::vector<std::vector<cv::Rect>>& areas,
-	const std::string& output_folder, const std::string& output_file,
-	int num_generate, double yaw_range, double pitch_range, double roll_range,
-	double blur_sigma, double noise_sigma, double x_slide, double y_slide, double aspect_range,
-	double hflip_ratio, double vflip_ratio);
+	const std::string& output_folder, const std::string& output_file, const AugmentationParams& params);
+
+//! DataAugmentation() of whole images found by scanner
+/*!
+Images are queued to one pool of threads as soon as they are found, without waiting for the end of the scan or for the images found before.
+*/
+void DataAugmentation(ImageFileScanner& scanner, const std::string& output_folder, const std::string& output_file,
+	const AugmentationParams& params);
+
+//! Render samples in plan log (params.plan_log of DataAugmentation()) again with the logged parameters
+/*!
+No random number is drawn, so output images are the same as the logged ones as long as input images are not changed.
+\param[in] log_file plan log
+\param[in] output_folder folder of output images
+\param[in] output_file annotation file to which lines of rendered images are added
+\param[in] params replay_ids, num_threads, verbose, and stats_file are used. The others are read from log.
+\return false if log cannot be read
+*/
+bool ReplayTransformPlans(const std::string& log_file, const std::string& output_folder, const std::string& output_file,
+	const AugmentationParams& params);
 
 
 #endif
\ No newline at end of file
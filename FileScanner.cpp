@@ -0,0 +1,175 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "FileScanner.h"
+#include "Scheduler.h"
+#include "Util.h"
+#include <algorithm>
+#include <iostream>
+#include <boost/filesystem/operations.hpp>
+
+
+ImageFileScanner::ImageFileScanner(const std::string& dir, int num_threads) : active_(0), stop_(false)
+{
+	Node root;
+	root.dir = boost::filesystem::path(dir);
+	root.listed = false;
+	nodes_.push_back(root);
+	pending_.push_back(&nodes_.back());
+
+	Cursor cursor = { &nodes_.back(), 0, 0 };
+	cursors_.push_back(cursor);
+
+	num_threads = ResolveNumThreads(num_threads);
+	for (int i = 0; i < num_threads; i++){
+		threads_.push_back(std::thread(&ImageFileScanner::Work, this));
+	}
+}
+
+
+ImageFileScanner::~ImageFileScanner()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	pending_cond_.notify_all();
+	for (int i = 0; i < threads_.size(); i++){
+		threads_[i].join();
+	}
+}
+
+
+void ImageFileScanner::Work()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true){
+		// Scan is finished when no directory is pending or being listed
+		while (!stop_ && pending_.empty() && active_ > 0){
+			pending_cond_.wait(lock);
+		}
+		if (stop_ || pending_.empty())
+			break;
+
+		Node* node = pending_.back();
+		pending_.pop_back();
+		active_++;
+
+		std::vector<std::string> files;
+		std::vector<boost::filesystem::path> dirs;
+		lock.unlock();
+		List(node, files, dirs);
+		lock.lock();
+
+		// Children are pushed in reverse order, so that they are listed in the order of traversal
+		node->files.swap(files);
+		for (int i = 0; i < dirs.size(); i++){
+			Node child;
+			child.dir = dirs[i];
+			child.listed = false;
+			nodes_.push_back(child);
+			node->children.push_back(&nodes_.back());
+		}
+		for (int i = (int)node->children.size() - 1; i >= 0; i--){
+			pending_.push_back(node->children[i]);
+		}
+		node->listed = true;
+		active_--;
+		pending_cond_.notify_all();
+		listed_cond_.notify_all();
+	}
+}
+
+
+void ImageFileScanner::List(Node* node, std::vector<std::string>& files, std::vector<boost::filesystem::path>& dirs)
+{
+	using namespace boost::filesystem;
+
+	boost::system::error_code ec;
+	directory_iterator end;
+	for (directory_iterator p(node->dir, ec); !ec && p != end; p.increment(ec)){
+		file_status link_status = p->symlink_status(ec);
+		if (ec)
+			break;
+		if (is_directory(link_status)){
+			dirs.push_back(p->path());
+		}
+		else if (util::hasImageExtention(p->path().string())){
+			// Symbolic link is followed only to a file
+			if (is_regular_file(link_status) || (is_symlink(link_status) && is_regular_file(p->status(ec)))){
+				files.push_back(p->path().generic_string());
+			}
+			ec.clear();
+		}
+	}
+	if (ec){
+		std::cout << "Fail to read directory " << node->dir.string() << ": " << ec.message() << std::endl;
+	}
+	std::sort(files.begin(), files.end());
+	std::sort(dirs.begin(), dirs.end());
+}
+
+
+bool ImageFileScanner::NextBatch(std::vector<std::string>& files, size_t max_files)
+{
+	files.clear();
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!cursors_.empty() && files.size() < max_files){
+		Cursor& cursor = cursors_.back();
+		Node* node = cursor.node;
+		if (!node->listed){
+			// Return files already found instead of waiting
+			if (!files.empty())
+				break;
+			listed_cond_.wait(lock);
+			continue;
+		}
+
+		// Files of directory, and then its subdirectories
+		if (cursor.file < node->files.size()){
+			size_t num = std::min(node->files.size() - cursor.file, max_files - files.size());
+			files.insert(files.end(), node->files.begin() + cursor.file, node->files.begin() + cursor.file + num);
+			cursor.file += num;
+		}
+		else if (cursor.child < node->children.size()){
+			Cursor child = { node->children[cursor.child++], 0, 0 };
+			cursors_.push_back(child);
+		}
+		else{
+			std::vector<std::string>().swap(node->files);
+			cursors_.pop_back();
+		}
+	}
+	return !files.empty();
+}
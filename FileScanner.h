@@ -0,0 +1,107 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __FILE_SCANNER__
+#define __FILE_SCANNER__
+
+#include <boost/filesystem/path.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Recursive scanner of image files in directory tree
+/*!
+Directories are listed by a pool of threads, so that stat of entries in different directories runs in parallel.
+Files are returned by NextBatch() while the scan continues, in the order of depth-first traversal
+with entries sorted by name, so that the order does not depend on the number of threads.
+Symbolic links to files are followed, but symbolic links to directories are not (to avoid loops).
+*/
+class ImageFileScanner
+{
+public:
+	//! Start scanning dir
+	/*!
+	\param[in] dir root directory
+	\param[in] num_threads number of threads listing directories (0: number of hardware threads)
+	*/
+	ImageFileScanner(const std::string& dir, int num_threads = 0);
+
+	//! Stop scanning
+	~ImageFileScanner();
+
+	//! Wait for image files which are found next
+	/*!
+	Files already found are returned without waiting for the rest of the scan.
+	\param[out] files image files (generic format)
+	\param[in] max_files maximum number of files to be returned
+	\return false if all files have been returned
+	*/
+	bool NextBatch(std::vector<std::string>& files, size_t max_files);
+
+private:
+	struct Node
+	{
+		boost::filesystem::path dir;
+		bool listed;
+		std::vector<std::string> files;
+		std::vector<Node*> children;
+	};
+
+	// Position of depth-first traversal in node
+	struct Cursor
+	{
+		Node* node;
+		size_t file;
+		size_t child;
+	};
+
+	void Work();
+	void List(Node* node, std::vector<std::string>& files, std::vector<boost::filesystem::path>& dirs);
+
+	std::deque<Node> nodes_;		// references to nodes are kept while new nodes are added
+	std::vector<Node*> pending_;	// directories to be listed (last is listed first)
+	int active_;					// directories being listed
+	bool stop_;
+	std::vector<Cursor> cursors_;
+
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable pending_cond_;
+	std::condition_variable listed_cond_;
+};
+
+
+#endif
@@ -0,0 +1,294 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "ImageLoader.h"
+#include <opencv2/highgui/highgui.hpp>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#ifdef HAVE_LIBJPEG_TURBO
+#include <cstdio>
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+
+// Unsigned value of 2 or 4 bytes in byte order of TIFF
+unsigned int ReadTiffValue(const unsigned char* p, int bytes, bool little_endian)
+{
+	unsigned int value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (unsigned int)p[little_endian ? i : bytes - 1 - i] << (8 * i);
+	return value;
+}
+
+
+// Orientation tag (0x0112) in IFD0 of APP1 segment. 1 (normal) if it has no orientation.
+int ExifOrientation(const std::vector<unsigned char>& app1)
+{
+	// "Exif\0\0" and TIFF header (byte order, 42, offset of IFD0)
+	if (app1.size() < 14 || std::memcmp(&app1[0], "Exif\0\0", 6) != 0)
+		return 1;
+	const unsigned char* tiff = &app1[6];
+	size_t tiff_size = app1.size() - 6;
+	bool little_endian;
+	if (tiff[0] == 'I' && tiff[1] == 'I')
+		little_endian = true;
+	else if (tiff[0] == 'M' && tiff[1] == 'M')
+		little_endian = false;
+	else
+		return 1;
+	if (ReadTiffValue(tiff + 2, 2, little_endian) != 42)
+		return 1;
+
+	// Entries of IFD0 (tag, type, count, and value) are 12 bytes each
+	size_t ifd = ReadTiffValue(tiff + 4, 4, little_endian);
+	if (ifd + 2 > tiff_size)
+		return 1;
+	int num_entries = ReadTiffValue(tiff + ifd, 2, little_endian);
+	for (int i = 0; i < num_entries; i++){
+		size_t entry = ifd + 2 + 12 * i;
+		if (entry + 12 > tiff_size)
+			break;
+		if (ReadTiffValue(tiff + entry, 2, little_endian) == 0x0112){
+			// SHORT value is at the head of value field
+			if (ReadTiffValue(tiff + entry + 2, 2, little_endian) != 3)
+				return 1;
+			return ReadTiffValue(tiff + entry + 8, 2, little_endian);
+		}
+	}
+	return 1;
+}
+
+
+bool ReadJpegSize(const std::string& file, cv::Size& size)
+{
+	std::ifstream ifs(file.c_str(), std::ios::binary);
+	if (!ifs.is_open())
+		return false;
+
+	// SOI
+	if (ifs.get() != 0xFF || ifs.get() != 0xD8)
+		return false;
+
+	while (ifs.good()){
+		// Marker (fill bytes 0xFF may precede it)
+		int marker = ifs.get();
+		if (marker != 0xFF)
+			return false;
+		while (marker == 0xFF)
+			marker = ifs.get();
+		if (marker == EOF || marker == 0xD9 || marker == 0xDA)
+			return false;
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+			continue;
+
+		int length = (ifs.get() << 8);
+		length |= ifs.get();
+		if (!ifs.good() || length < 2)
+			return false;
+
+		// Exif orientation other than normal rotates the image decoded by cv::imread()
+		if (marker == 0xE1){
+			std::vector<unsigned char> app1(length - 2);
+			if (!app1.empty() && !ifs.read(reinterpret_cast<char*>(&app1[0]), app1.size()))
+				return false;
+			if (ExifOrientation(app1) != 1)
+				return false;
+			continue;
+		}
+
+		// SOFn (except DHT, JPG, and DAC)
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC){
+			unsigned char sof[5];
+			if (length < 7 || !ifs.read(reinterpret_cast<char*>(sof), 5))
+				return false;
+			size.height = (sof[1] << 8) | sof[2];
+			size.width = (sof[3] << 8) | sof[4];
+			return size.width > 0 && size.height > 0;
+		}
+
+		ifs.seekg(length - 2, std::ios::cur);
+	}
+	return false;
+}
+
+
+cv::Rect ReduceRect(const cv::Rect& rect, int reduction)
+{
+	if (reduction == 1)
+		return rect;
+	int x1 = cvFloor((double)rect.x / reduction);
+	int y1 = cvFloor((double)rect.y / reduction);
+	int x2 = cvCeil((double)(rect.x + rect.width) / reduction);
+	int y2 = cvCeil((double)(rect.y + rect.height) / reduction);
+	return cv::Rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+
+// Flags of cv::imread() to decode at 1/reduction size
+int ReducedReadFlags(int flags, int reduction)
+{
+	bool gray = (flags == cv::IMREAD_GRAYSCALE);
+	switch (reduction){
+	case 2:
+		return gray ? cv::IMREAD_REDUCED_GRAYSCALE_2 : cv::IMREAD_REDUCED_COLOR_2;
+	case 4:
+		return gray ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_COLOR_4;
+	case 8:
+		return gray ? cv::IMREAD_REDUCED_GRAYSCALE_8 : cv::IMREAD_REDUCED_COLOR_8;
+	default:
+		return flags;
+	}
+}
+
+
+#ifdef HAVE_LIBJPEG_TURBO
+
+struct JpegErrorManager
+{
+	jpeg_error_mgr pub;
+	jmp_buf jump;
+};
+
+
+void JpegErrorExit(j_common_ptr cinfo)
+{
+	longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
+
+
+// State of DecodeJpegRegion(). It is owned by the caller of DecodeJpegRows(),
+// so that it keeps its value after longjmp() from libjpeg returns to setjmp() in DecodeJpegRows().
+struct JpegRegionDecode
+{
+	jpeg_decompress_struct cinfo;
+	JpegErrorManager jerr;
+	FILE* fp;
+	cv::Rect rect;			// roi on decoded image
+	JDIMENSION xoffset;		// left of decoded columns (iMCU boundary)
+	cv::Mat rows;			// decoded rows of rect
+};
+
+
+// Decode rows of roi into state. Nothing but state is modified after setjmp().
+// Return false if libjpeg failed.
+bool DecodeJpegRows(JpegRegionDecode* state, bool gray, int reduction, const cv::Rect& roi)
+{
+	if (setjmp(state->jerr.jump))
+		return false;
+
+	jpeg_create_decompress(&state->cinfo);
+	jpeg_stdio_src(&state->cinfo, state->fp);
+	jpeg_read_header(&state->cinfo, TRUE);
+	state->cinfo.scale_num = 1;
+	state->cinfo.scale_denom = reduction;
+	state->cinfo.out_color_space = gray ? JCS_GRAYSCALE : JCS_EXT_BGR;
+	jpeg_start_decompress(&state->cinfo);
+
+	state->rect = roi & cv::Rect(0, 0, state->cinfo.output_width, state->cinfo.output_height);
+	if (state->rect.width <= 0 || state->rect.height <= 0)
+		return true;
+
+	// Columns are extended to iMCU boundaries
+	state->xoffset = state->rect.x;
+	JDIMENSION width = state->rect.width;
+	jpeg_crop_scanline(&state->cinfo, &state->xoffset, &width);
+
+	// Rows above roi are skipped without IDCT, and rows below it are not decoded
+	if (state->rect.y > 0)
+		jpeg_skip_scanlines(&state->cinfo, state->rect.y);
+
+	state->rows.create(state->rect.height, width, gray ? CV_8UC1 : CV_8UC3);
+	for (int y = 0; y < state->rect.height; y++){
+		JSAMPROW row = state->rows.ptr(y);
+		jpeg_read_scanlines(&state->cinfo, &row, 1);
+	}
+	return true;
+}
+
+
+// Decode roi of JPEG with crop and skip of scanlines
+cv::Mat DecodeJpegRegion(const std::string& file, bool gray, int reduction, const cv::Rect& roi)
+{
+	JpegRegionDecode state;
+	state.fp = fopen(file.c_str(), "rb");
+	if (!state.fp)
+		return cv::Mat();
+	state.cinfo.err = jpeg_std_error(&state.jerr.pub);
+	state.jerr.pub.error_exit = JpegErrorExit;
+
+	bool ok = DecodeJpegRows(&state, gray, reduction, roi);
+	jpeg_destroy_decompress(&state.cinfo);
+	fclose(state.fp);
+	if (!ok || state.rows.empty())
+		return cv::Mat();
+
+	int x = state.rect.x - state.xoffset;
+	return state.rows.colRange(x, x + state.rect.width);
+}
+
+#endif
+
+
+bool CanDecodeRegion()
+{
+#ifdef HAVE_LIBJPEG_TURBO
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+cv::Mat LoadImageRegion(const std::string& file, int flags, int reduction, const cv::Rect& roi)
+{
+#ifdef HAVE_LIBJPEG_TURBO
+	if (flags == cv::IMREAD_COLOR || flags == cv::IMREAD_GRAYSCALE){
+		cv::Mat region = DecodeJpegRegion(file, flags == cv::IMREAD_GRAYSCALE, reduction, roi);
+		if (!region.empty())
+			return region;
+	}
+#endif
+
+	cv::Mat img = cv::imread(file, ReducedReadFlags(flags, reduction));
+	if (img.empty())
+		return img;
+
+	cv::Rect rect = roi & cv::Rect(0, 0, img.cols, img.rows);
+	if (rect.size() == img.size())
+		return img;
+
+	// Copy to release the rest of image
+	return img(rect).clone();
+}
@@ -0,0 +1,78 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __IMAGE_LOADER__
+#define __IMAGE_LOADER__
+
+#include <opencv2/core/core.hpp>
+#include <string>
+
+//! How source image is loaded
+struct SourceLoad
+{
+	bool region;		//!< decode region of JPEG by LoadImageRegion() (false: decode whole image)
+	int reduction;		//!< JPEG is decoded at 1/reduction size
+	cv::Rect rect;		//!< region of reduced image
+};
+
+//! Read size of JPEG image from its header without decoding
+/*!
+\param[in] file image file
+\param[out] size size of image
+\return false if file is not JPEG, or its Exif orientation is not normal (cv::imread() rotates it)
+*/
+bool ReadJpegSize(const std::string& file, cv::Size& size);
+
+//! Decode region of image at reduced resolution
+/*!
+If built with HAVE_LIBJPEG_TURBO, only the rows and MCU columns of JPEG which cover roi are decoded.
+Otherwise whole image is decoded (at reduced resolution by cv::IMREAD_REDUCED_*) and roi is cropped.
+\param[in] file image file
+\param[in] flags cv::IMREAD_COLOR or cv::IMREAD_GRAYSCALE
+\param[in] reduction 1, 2, 4, or 8. Image is decoded at 1/reduction size (rounded up).
+\param[in] roi region of reduced image
+\return decoded region (empty if failed)
+*/
+cv::Mat LoadImageRegion(const std::string& file, int flags, int reduction, const cv::Rect& roi);
+
+//! Whether LoadImageRegion() decodes only the region (built with HAVE_LIBJPEG_TURBO)
+/*!
+Otherwise it decodes whole image, so cropping to a region does not reduce the peak memory of decoding.
+*/
+bool CanDecodeRegion();
+
+//! Rectangle on image reduced to 1/reduction size (outer pixel boundaries)
+cv::Rect ReduceRect(const cv::Rect& rect, int reduction);
+
+
+#endif
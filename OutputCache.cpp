@@ -0,0 +1,226 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "OutputCache.h"
+#include "Util.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <ctime>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+
+// Subfolder of content hashes of input images
+const char* SOURCE_HASH_FOLDER = "sources";
+
+// Hash of a file modified within this time (second) is not recorded,
+// since the file may be changed again in the same second without changing its modification time
+const int SOURCE_HASH_MIN_AGE = 2;
+
+
+// Temporary file next to file, unique among threads and processes
+boost::filesystem::path TemporaryPath(const boost::filesystem::path& file)
+{
+	boost::filesystem::path tmp = file;
+	tmp += "." + boost::filesystem::unique_path().string() + ".tmp";
+	return tmp;
+}
+
+
+// Hard link from to to (copy if hard link is not supported).
+// The link is made under a temporary name and renamed over to, so the old inode of to is never written.
+bool LinkFile(const boost::filesystem::path& from, const boost::filesystem::path& to)
+{
+	using namespace boost::filesystem;
+
+	path tmp = TemporaryPath(to);
+	boost::system::error_code ec;
+	create_hard_link(from, tmp, ec);
+	if (ec){
+		ec.clear();
+		copy_file(from, tmp, copy_option::overwrite_if_exists, ec);
+	}
+	if (!ec)
+		rename(tmp, to, ec);
+	if (ec){
+		boost::system::error_code ignored;
+		remove(tmp, ignored);
+	}
+	return !ec;
+}
+
+
+void UnlinkOutputFile(const std::string& file)
+{
+	boost::system::error_code ec;
+	boost::filesystem::remove(file, ec);
+}
+
+
+OutputCache::OutputCache(const std::string& cache_folder, const std::string& manifest_file) :
+	folder_(cache_folder), manifest_file_(manifest_file)
+{
+	if (!Enabled())
+		return;
+
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(boost::filesystem::path(folder_) / SOURCE_HASH_FOLDER, ec);
+
+	// Manifest of this run
+	std::ofstream ofs(manifest_file_, std::ios::trunc);
+}
+
+
+bool OutputCache::Fetch(const std::string& key, const std::string& dst_file, std::vector<cv::Rect>& rects, std::string& tag)
+{
+	using namespace boost::filesystem;
+
+	if (!Enabled())
+		return false;
+
+	path img_file = path(folder_) / path(key + ".png");
+	path anno_file = path(folder_) / path(key + ".txt");
+	std::ifstream ifs(anno_file.string());
+	if (!ifs.is_open() || !exists(img_file)){
+		AddManifestLine(false, key, dst_file);
+		return false;
+	}
+
+	// first line: number of rectangles and x y width height of each, second line: tag
+	std::string line;
+	std::getline(ifs, line);
+	std::istringstream iss(line);
+	int num = 0;
+	iss >> num;
+	rects.clear();
+	for (int i = 0; i < num; i++){
+		cv::Rect rect;
+		iss >> rect.x >> rect.y >> rect.width >> rect.height;
+		rects.push_back(rect);
+	}
+	tag.clear();
+	std::getline(ifs, tag);
+
+	if (iss.fail() || !LinkFile(img_file, path(dst_file))){
+		AddManifestLine(false, key, dst_file);
+		return false;
+	}
+	AddManifestLine(true, key, dst_file);
+	return true;
+}
+
+
+void OutputCache::Store(const std::string& key, const std::string& dst_file, const std::vector<cv::Rect>& rects, const std::string& tag)
+{
+	using namespace boost::filesystem;
+
+	if (!Enabled())
+		return;
+
+	// Annotation is written after image, so that a key with annotation always has its image
+	path img_file = path(folder_) / path(key + ".png");
+	path anno_file = path(folder_) / path(key + ".txt");
+	if (!LinkFile(path(dst_file), img_file))
+		return;
+
+	path tmp = TemporaryPath(anno_file);
+	{
+		std::ofstream ofs(tmp.string());
+		ofs << rects.size();
+		for (int i = 0; i < rects.size(); i++){
+			ofs << " " << rects[i].x << " " << rects[i].y << " " << rects[i].width << " " << rects[i].height;
+		}
+		ofs << std::endl << tag << std::endl;
+	}
+	boost::system::error_code ec;
+	rename(tmp, anno_file, ec);
+	if (ec)
+		remove(tmp, ec);
+}
+
+
+bool OutputCache::HashSource(const std::string& file, unsigned long long& hash, bool& read)
+{
+	using namespace boost::filesystem;
+
+	read = true;
+	if (!Enabled())
+		return util::HashFile(file, hash);
+
+	boost::system::error_code ec;
+	path abs_file = canonical(path(file), ec);
+	boost::uintmax_t size = ec ? 0 : file_size(abs_file, ec);
+	std::time_t mtime = ec ? 0 : last_write_time(abs_file, ec);
+	if (ec)
+		return util::HashFile(file, hash);
+
+	// first line: path, size, and modification time, second line: content hash in hex
+	std::ostringstream identity;
+	identity << abs_file.string() << " " << size << " " << mtime;
+	std::string id = identity.str();
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", util::HashBytes(id.data(), id.size()));
+	path entry_file = path(folder_) / SOURCE_HASH_FOLDER / path(std::string(name) + ".txt");
+	{
+		std::ifstream ifs(entry_file.string());
+		std::string line;
+		if (std::getline(ifs, line) && line == id && (ifs >> std::hex >> hash)){
+			read = false;
+			return true;
+		}
+	}
+
+	if (!util::HashFile(file, hash))
+		return false;
+	if (std::time(NULL) - mtime < SOURCE_HASH_MIN_AGE)
+		return true;
+
+	path tmp = TemporaryPath(entry_file);
+	{
+		std::ofstream ofs(tmp.string());
+		ofs << id << std::endl << std::hex << hash << std::endl;
+	}
+	rename(tmp, entry_file, ec);
+	if (ec)
+		remove(tmp, ec);
+	return true;
+}
+
+
+void OutputCache::AddManifestLine(bool hit, const std::string& key, const std::string& dst_file)
+{
+	std::lock_guard<std::mutex> lock(manifest_mutex_);
+	std::ofstream ofs(manifest_file_, std::ios::app);
+	ofs << (hit ? "hit " : "miss ") << key << " " << dst_file << std::endl;
+}
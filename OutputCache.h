@@ -0,0 +1,92 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __OUTPUT_CACHE__
+#define __OUTPUT_CACHE__
+
+#include <opencv2/core/core.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//! Cache of output images keyed by hash of everything which determines them
+/*!
+Cached images are stored as <key>.png and their annotations as <key>.txt in cache folder.
+Output files are hard-linked to the cached images (copied if the file system does not support hard links).
+Every lookup is recorded in manifest file as "hit|miss <key> <output file>".
+Content hashes of input images are kept in "sources" subfolder, keyed by absolute path, size, and modification time of the file.
+Files are linked or written under temporary names and renamed, so Fetch() and Store() can be called from several threads,
+also for the same key, and a reader never sees a partial file.
+*/
+class OutputCache
+{
+public:
+	//! Cache is disabled if cache_folder is empty
+	OutputCache(const std::string& cache_folder, const std::string& manifest_file);
+
+	bool Enabled() const { return !folder_.empty(); }
+
+	//! Link cached image of key to dst_file and read its annotation
+	/*!
+	\return false if key is not cached
+	*/
+	bool Fetch(const std::string& key, const std::string& dst_file, std::vector<cv::Rect>& rects, std::string& tag);
+
+	//! Register rendered dst_file and its annotation as cache of key
+	void Store(const std::string& key, const std::string& dst_file, const std::vector<cv::Rect>& rects, const std::string& tag);
+
+	//! Content hash of file (util::HashFile)
+	/*!
+	The file is read only if its path, size, or modification time is not recorded yet (or the cache is disabled).
+	\param[out] read whether the file was read
+	\return false if the file cannot be read
+	*/
+	bool HashSource(const std::string& file, unsigned long long& hash, bool& read);
+
+private:
+	void AddManifestLine(bool hit, const std::string& key, const std::string& dst_file);
+
+	std::string folder_;
+	std::string manifest_file_;
+	std::mutex manifest_mutex_;
+};
+
+//! Remove output file before it is written again
+/*!
+Output file may be hard-linked to a cached image (also by an earlier run),
+and writing it in place would change the cached image of another key.
+*/
+void UnlinkOutputFile(const std::string& file);
+
+
+#endif
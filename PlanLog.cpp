@@ -0,0 +1,318 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "PlanLog.h"
+#include <algorithm>
+#include <cstring>
+
+
+// Signature and version at the beginning of plan log
+const char PLAN_LOG_SIGNATURE[4] = { 'D', 'A', 'P', 'L' };
+const unsigned int PLAN_LOG_VERSION = 3;
+
+// Types of records
+const char SOURCE_RECORD = 'S';
+const char SAMPLE_RECORD = 'P';
+
+// Longer file name is regarded as broken record
+const unsigned int MAX_FILE_NAME_LENGTH = 1 << 16;
+
+// Bits of enabled stages of plan
+enum PlanFlag { FLAG_ROTATE = 1, FLAG_COLOR = 2, FLAG_LUT = 4, FLAG_NOISE = 8, FLAG_BLUR = 16, FLAG_HFLIP = 32, FLAG_VFLIP = 64 };
+
+
+// Bits of value (integer, or IEEE 754 double)
+template<typename T>
+unsigned long long ToBits(const T& value)
+{
+	return (unsigned long long)value;
+}
+
+
+unsigned long long ToBits(double value)
+{
+	unsigned long long bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+
+// Value of bits
+template<typename T>
+T FromBits(unsigned long long bits)
+{
+	return (T)bits;
+}
+
+
+template<>
+double FromBits<double>(unsigned long long bits)
+{
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+
+// Append value to record in little endian, so that log is read on any machine
+template<typename T>
+void Put(std::string& buf, const T& value)
+{
+	unsigned long long bits = ToBits(value);
+	for (int i = 0; i < sizeof(T); i++){
+		buf.push_back((char)((bits >> (8 * i)) & 0xFF));
+	}
+}
+
+
+void PutRect(std::string& buf, const cv::Rect& rect)
+{
+	Put(buf, rect.x);
+	Put(buf, rect.y);
+	Put(buf, rect.width);
+	Put(buf, rect.height);
+}
+
+
+// Reader of values written by Put(). Values are zero after the end of file.
+class RecordReader
+{
+public:
+	explicit RecordReader(std::istream& is) : is_(is){}
+
+	bool Good() const { return !is_.fail(); }
+
+	template<typename T>
+	T Get()
+	{
+		unsigned char bytes[sizeof(T)];
+		if (!is_.read(reinterpret_cast<char*>(bytes), sizeof(T)))
+			return T();
+		unsigned long long bits = 0;
+		for (int i = 0; i < sizeof(T); i++){
+			bits |= (unsigned long long)bytes[i] << (8 * i);
+		}
+		return FromBits<T>(bits);
+	}
+
+	cv::Rect GetRect()
+	{
+		cv::Rect rect;
+		rect.x = Get<int>();
+		rect.y = Get<int>();
+		rect.width = Get<int>();
+		rect.height = Get<int>();
+		return rect;
+	}
+
+	std::string GetString(unsigned int size)
+	{
+		if (size > MAX_FILE_NAME_LENGTH){
+			is_.setstate(std::ios::failbit);
+			return std::string();
+		}
+		std::string str(size, '\0');
+		if (size > 0)
+			is_.read(&str[0], size);
+		return str;
+	}
+
+private:
+	std::istream& is_;
+};
+
+
+PlanLogWriter::PlanLogWriter(const std::string& file, const PlanLogHeader& header) :
+	ofs_(file.c_str(), std::ios::binary | std::ios::trunc)
+{
+	std::string buf(PLAN_LOG_SIGNATURE, sizeof(PLAN_LOG_SIGNATURE));
+	Put(buf, PLAN_LOG_VERSION);
+	Put(buf, header.render_version);
+	Put(buf, (unsigned char)header.whole_image);
+	Put(buf, (unsigned char)header.sweep);
+	Put(buf, (unsigned char)header.load_unchanged);
+	Put(buf, header.min_visible_ratio);
+	ofs_.write(buf.data(), buf.size());
+}
+
+
+void PlanLogWriter::AddSource(const PlanLogSource& source)
+{
+	std::string buf(1, SOURCE_RECORD);
+	Put(buf, source.index);
+	Put(buf, (unsigned int)source.file.size());
+	buf.append(source.file);
+	Put(buf, source.content_hash);
+	Put(buf, (unsigned char)source.load.region);
+	Put(buf, source.load.reduction);
+	PutRect(buf, source.load.rect);
+	Put(buf, (unsigned int)source.rects.size());
+	for (int i = 0; i < source.rects.size(); i++){
+		PutRect(buf, source.rects[i]);
+	}
+
+	// Record is written at once, so that records of threads are not mixed
+	std::lock_guard<std::mutex> lock(mutex_);
+	ofs_.write(buf.data(), buf.size());
+}
+
+
+void PlanLogWriter::AddSample(const PlanLogSample& sample)
+{
+	const TransformPlan& plan = sample.plan;
+	unsigned char flags = (plan.rotate ? FLAG_ROTATE : 0) | (plan.color ? FLAG_COLOR : 0) | (plan.lut ? FLAG_LUT : 0) |
+		(plan.noise ? FLAG_NOISE : 0) | (plan.blur ? FLAG_BLUR : 0) | (plan.hflip ? FLAG_HFLIP : 0) | (plan.vflip ? FLAG_VFLIP : 0);
+
+	std::string buf(1, SAMPLE_RECORD);
+	Put(buf, sample.source);
+	Put(buf, sample.area_index);
+	Put(buf, sample.sample_index);
+	PutRect(buf, plan.rect);
+	Put(buf, plan.output_size.width);
+	Put(buf, plan.output_size.height);
+	Put(buf, flags);
+	Put(buf, plan.yaw);
+	Put(buf, plan.pitch);
+	Put(buf, plan.roll);
+	Put(buf, plan.hue);
+	Put(buf, plan.saturation);
+	Put(buf, plan.brightness);
+	Put(buf, plan.contrast);
+	Put(buf, plan.gamma);
+	Put(buf, plan.noise_sigma);
+	Put(buf, plan.noise_seed);
+	Put(buf, plan.blur_size);
+	Put(buf, plan.blur_sigma);
+	PutRect(buf, sample.tile);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	ofs_.write(buf.data(), buf.size());
+}
+
+
+// Read signature and header
+bool ReadPlanLogHeader(std::istream& is, PlanLogHeader& header)
+{
+	char signature[sizeof(PLAN_LOG_SIGNATURE)];
+	if (!is.read(signature, sizeof(signature)) || !std::equal(signature, signature + sizeof(signature), PLAN_LOG_SIGNATURE))
+		return false;
+
+	RecordReader reader(is);
+	if (reader.Get<unsigned int>() != PLAN_LOG_VERSION)
+		return false;
+	header.render_version = reader.Get<int>();
+	header.whole_image = (reader.Get<unsigned char>() != 0);
+	header.sweep = (reader.Get<unsigned char>() != 0);
+	header.load_unchanged = (reader.Get<unsigned char>() != 0);
+	header.min_visible_ratio = reader.Get<double>();
+	return reader.Good();
+}
+
+
+bool IsPlanLog(const std::string& file)
+{
+	std::ifstream ifs(file.c_str(), std::ios::binary);
+	PlanLogHeader header;
+	return ifs.is_open() && ReadPlanLogHeader(ifs, header);
+}
+
+
+bool ReadPlanLog(const std::string& file, PlanLogHeader& header, std::vector<PlanLogSource>& sources,
+	std::vector<PlanLogSample>& samples)
+{
+	std::ifstream ifs(file.c_str(), std::ios::binary);
+	if (!ifs.is_open() || !ReadPlanLogHeader(ifs, header))
+		return false;
+
+	sources.clear();
+	samples.clear();
+	RecordReader reader(ifs);
+	char type;
+	while (ifs.get(type)){
+		if (type == SOURCE_RECORD){
+			PlanLogSource source;
+			source.index = reader.Get<int>();
+			source.file = reader.GetString(reader.Get<unsigned int>());
+			source.content_hash = reader.Get<unsigned long long>();
+			source.load.region = (reader.Get<unsigned char>() != 0);
+			source.load.reduction = reader.Get<int>();
+			source.load.rect = reader.GetRect();
+			unsigned int num_rects = reader.Get<unsigned int>();
+			for (unsigned int i = 0; i < num_rects && reader.Good(); i++){
+				source.rects.push_back(reader.GetRect());
+			}
+			if (!reader.Good())
+				break;
+			sources.push_back(source);
+		}
+		else if (type == SAMPLE_RECORD){
+			PlanLogSample sample;
+			TransformPlan& plan = sample.plan;
+			sample.source = reader.Get<int>();
+			sample.area_index = reader.Get<int>();
+			sample.sample_index = reader.Get<int>();
+			plan.rect = reader.GetRect();
+			plan.output_size.width = reader.Get<int>();
+			plan.output_size.height = reader.Get<int>();
+			unsigned char flags = reader.Get<unsigned char>();
+			plan.rotate = (flags & FLAG_ROTATE) != 0;
+			plan.color = (flags & FLAG_COLOR) != 0;
+			plan.lut = (flags & FLAG_LUT) != 0;
+			plan.noise = (flags & FLAG_NOISE) != 0;
+			plan.blur = (flags & FLAG_BLUR) != 0;
+			plan.hflip = (flags & FLAG_HFLIP) != 0;
+			plan.vflip = (flags & FLAG_VFLIP) != 0;
+			plan.yaw = reader.Get<double>();
+			plan.pitch = reader.Get<double>();
+			plan.roll = reader.Get<double>();
+			plan.hue = reader.Get<double>();
+			plan.saturation = reader.Get<double>();
+			plan.brightness = reader.Get<double>();
+			plan.contrast = reader.Get<double>();
+			plan.gamma = reader.Get<double>();
+			plan.noise_sigma = reader.Get<double>();
+			plan.noise_seed = reader.Get<unsigned int>();
+			plan.blur_size = reader.Get<int>();
+			plan.blur_sigma = reader.Get<double>();
+			sample.tile = reader.GetRect();
+			if (!reader.Good())
+				break;
+			samples.push_back(sample);
+		}
+		else{
+			// Broken record. Records before it are kept.
+			break;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,110 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __PLAN_LOG__
+#define __PLAN_LOG__
+
+#include "DataAugmentation.h"
+#include "ImageLoader.h"
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**********************************************
+Binary log of TransformPlan of every rendered sample, to render the samples again without random numbers.
+The file starts with PlanLogHeader, followed by source records and sample records.
+Values are written in little endian (double in IEEE 754), so that the log can be replayed on another machine.
+A source record is written before the samples of the image.
+**********************************************/
+
+//! Settings of logged run which are needed to replay its samples
+struct PlanLogHeader
+{
+	int render_version;			//!< version of rendering of logged run. Samples are replayed only by the same version.
+	bool whole_image;			//!< AugmentationParams::whole_image
+	bool sweep;					//!< rotation was rendered with precomputed sweep warps
+	bool load_unchanged;		//!< AugmentationParams::load_unchanged
+	double min_visible_ratio;	//!< AugmentationParams::min_visible_ratio
+};
+
+//! Input image of logged samples
+struct PlanLogSource
+{
+	int index;							//!< index of image in logged run (used in names of output images)
+	std::string file;					//!< image file
+	unsigned long long content_hash;	//!< hash of file (util::HashFile) to detect changed image
+	SourceLoad load;					//!< how image was loaded. Rectangles of plans are on loaded image.
+	std::vector<cv::Rect> rects;		//!< object rectangles on loaded image
+};
+
+//! Logged sample
+struct PlanLogSample
+{
+	int source;				//!< index of image
+	int area_index;			//!< index of area in image
+	int sample_index;		//!< index of sample of area
+	TransformPlan plan;		//!< all drawn parameters
+	cv::Rect tile;			//!< region of loaded image which was loaded for the area of tiled image (empty if not tiled)
+};
+
+//! Writer of plan log. Records can be added from several threads.
+class PlanLogWriter
+{
+public:
+	//! Create log file (truncated)
+	PlanLogWriter(const std::string& file, const PlanLogHeader& header);
+
+	bool IsOpen() const { return ofs_.is_open(); }
+
+	void AddSource(const PlanLogSource& source);
+	void AddSample(const PlanLogSample& sample);
+
+private:
+	std::ofstream ofs_;
+	std::mutex mutex_;
+};
+
+//! Test whether file starts with the signature of plan log
+bool IsPlanLog(const std::string& file);
+
+//! Read all records of plan log
+/*!
+A record which is cut at the end of file (e.g. the logged run was killed) is ignored.
+\return false if file is not plan log
+*/
+bool ReadPlanLog(const std::string& file, PlanLogHeader& header, std::vector<PlanLogSource>& sources,
+	std::vector<PlanLogSample>& samples);
+
+
+#endif
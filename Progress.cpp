@@ -0,0 +1,219 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "Progress.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <boost/filesystem/operations.hpp>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+
+static const char* const STAGE_NAMES[Progress::NUM_STAGES] = { "load", "render", "write" };
+
+
+long long PeakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;		// bytes
+#else
+	return usage.ru_maxrss * 1024LL;	// kilobytes
+#endif
+#endif
+}
+
+
+Progress::Progress(long long total, const std::string& stats_file, bool console, int num_threads, double interval) :
+	total_(total), stats_file_(stats_file), console_(console), num_threads_(num_threads), interval_(interval),
+	done_(0), cached_(0), failed_(0), bytes_read_(0), bytes_written_(0), stop_(false)
+{
+	for (int i = 0; i < NUM_STAGES; i++){
+		queue_[i] = 0;
+		busy_[i] = 0;
+	}
+	start_ = std::chrono::steady_clock::now();
+	last_ = Take();
+	thread_ = std::thread(&Progress::Run, this);
+}
+
+
+Progress::~Progress()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	stop_cond_.notify_all();
+	thread_.join();
+	Report(true);
+}
+
+
+Progress::Snapshot Progress::Take() const
+{
+	Snapshot snap;
+	snap.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+	snap.total = total_;
+	snap.done = done_;
+	snap.cached = cached_;
+	snap.failed = failed_;
+	snap.bytes_read = bytes_read_;
+	snap.bytes_written = bytes_written_;
+	for (int i = 0; i < NUM_STAGES; i++){
+		snap.busy[i] = busy_[i];
+	}
+	return snap;
+}
+
+
+void Progress::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (!stop_){
+		stop_cond_.wait_for(lock, std::chrono::duration<double>(interval_));
+		if (!stop_)
+			Report(false);
+	}
+}
+
+
+void Progress::Report(bool final)
+{
+	// Rates of the last interval (whole run for final report)
+	Snapshot now = Take();
+	Snapshot base = final ? Snapshot() : last_;
+	last_ = now;
+
+	double span = std::max(now.time - base.time, 1e-6);
+	long long finished = now.done + now.cached + now.failed;
+	double img_rate = (now.done + now.cached - base.done - base.cached) / span;
+	double read_rate = (now.bytes_read - base.bytes_read) / span / (1024 * 1024);
+	double write_rate = (now.bytes_written - base.bytes_written) / span / (1024 * 1024);
+	double busy[NUM_STAGES];
+	double utilization = 0;
+	for (int i = 0; i < NUM_STAGES; i++){
+		busy[i] = 100.0 * (now.busy[i] - base.busy[i]) * 1e-9 / span;
+		utilization += busy[i] / num_threads_;
+	}
+
+	double peak_rss = PeakResidentBytes() / (1024.0 * 1024);
+
+	// ETA from average rate of whole run
+	double eta = -1;
+	if (finished > 0 && now.time > 0){
+		eta = (now.total - finished) * now.time / finished;
+	}
+
+	if (console_){
+		std::ostringstream line;
+		line << std::fixed << std::setprecision(1);
+		line << "\r[" << finished << "/" << now.total << "] "
+			<< (now.total > 0 ? 100.0 * finished / now.total : 100.0) << "% "
+			<< img_rate << " img/s, read " << read_rate << " MB/s, write " << write_rate << " MB/s, queue";
+		for (int i = 0; i < NUM_STAGES; i++){
+			line << " " << STAGE_NAMES[i] << "=" << queue_[i];
+		}
+		line << ", busy";
+		for (int i = 0; i < NUM_STAGES; i++){
+			line << " " << STAGE_NAMES[i] << "=" << std::setprecision(0) << busy[i] << "%";
+		}
+		line << ", " << num_threads_ << " threads " << utilization << "% utilized";
+		if (eta >= 0){
+			long long sec = (long long)(eta + 0.5);
+			line << ", ETA " << sec / 3600 << ":" << std::setfill('0') << std::setw(2) << (sec / 60) % 60
+				<< ":" << std::setw(2) << sec % 60 << std::setfill(' ');
+		}
+		if (now.cached > 0 || now.failed > 0){
+			line << " (cached " << now.cached << ", failed " << now.failed << ")";
+		}
+		if (final){
+			line << ", peak RSS " << std::setprecision(0) << peak_rss << " MB";
+		}
+		line << "   ";
+		std::cout << line.str();
+		if (final)
+			std::cout << std::endl;
+		else
+			std::cout.flush();
+	}
+
+	if (!stats_file_.empty()){
+		// Written to temporary file and renamed, so that readers never see partial file
+		std::string tmp_file = stats_file_ + ".tmp";
+		{
+			std::ofstream ofs(tmp_file.c_str());
+			ofs << "{\"elapsed_sec\": " << now.time
+				<< ", \"total\": " << now.total
+				<< ", \"done\": " << now.done
+				<< ", \"cached\": " << now.cached
+				<< ", \"failed\": " << now.failed
+				<< ", \"images_per_sec\": " << img_rate
+				<< ", \"read_mb_per_sec\": " << read_rate
+				<< ", \"write_mb_per_sec\": " << write_rate
+				<< ", \"bytes_read\": " << now.bytes_read
+				<< ", \"bytes_written\": " << now.bytes_written;
+			ofs << ", \"queue\": {";
+			for (int i = 0; i < NUM_STAGES; i++){
+				ofs << (i ? ", " : "") << "\"" << STAGE_NAMES[i] << "\": " << queue_[i];
+			}
+			ofs << "}, \"busy_percent\": {";
+			for (int i = 0; i < NUM_STAGES; i++){
+				ofs << (i ? ", " : "") << "\"" << STAGE_NAMES[i] << "\": " << busy[i];
+			}
+			ofs << "}, \"threads\": " << num_threads_
+				<< ", \"utilization_percent\": " << utilization
+				<< ", \"peak_rss_mb\": " << peak_rss
+				<< ", \"eta_sec\": " << eta << ", \"finished\": " << (final ? "true" : "false") << "}" << std::endl;
+		}
+		boost::system::error_code ec;
+		boost::filesystem::rename(tmp_file, stats_file_, ec);
+	}
+}
@@ -0,0 +1,133 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __PROGRESS__
+#define __PROGRESS__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+//! Peak resident set size of this process (bytes, 0 if unknown)
+long long PeakResidentBytes();
+
+//! Progress reporter of DataAugmentation()
+/*!
+Workers only update atomic counters. A background thread reads them at every interval,
+shows throughput, queue depths, busy ratio of each stage, and ETA on console,
+and rewrites the stats file (JSON) for monitoring.
+Busy ratio of a stage is summed over threads, and utilization is the total busy time divided by
+elapsed time of all threads, which shows how well the work scales to the threads.
+The final report shows peak resident set size of the process.
+*/
+class Progress
+{
+public:
+	enum Stage { STAGE_LOAD, STAGE_RENDER, STAGE_WRITE, NUM_STAGES };
+
+	//! Start reporting
+	/*!
+	\param[in] total number of output images
+	\param[in] stats_file JSON file rewritten at every report (empty: not written)
+	\param[in] console show progress line on console
+	\param[in] num_threads number of worker threads
+	\param[in] interval interval of report (second)
+	*/
+	Progress(long long total, const std::string& stats_file, bool console, int num_threads = 1, double interval = 1.0);
+
+	//! Stop reporting and show the final report
+	~Progress();
+
+	//! Add output images found after start (e.g. while input directory is scanned)
+	void AddTotal(long long num) { total_ += num; }
+
+	void AddDone(long long num = 1) { done_ += num; }
+	void AddCached(long long num = 1) { cached_ += num; }
+	void AddFailed(long long num = 1) { failed_ += num; }
+	void AddBytesRead(long long bytes) { bytes_read_ += bytes; }
+	void AddBytesWritten(long long bytes) { bytes_written_ += bytes; }
+	void SetQueueDepth(Stage stage, long long depth) { queue_[stage] = depth; }
+
+	//! Measure busy time of stage while in scope
+	class Scope
+	{
+	public:
+		Scope(Progress& progress, Stage stage) : progress_(progress), stage_(stage), start_(std::chrono::steady_clock::now()){}
+		~Scope()
+		{
+			progress_.busy_[stage_] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+		}
+
+	private:
+		Progress& progress_;
+		Stage stage_;
+		std::chrono::steady_clock::time_point start_;
+	};
+
+private:
+	//! Values of counters at a time
+	struct Snapshot
+	{
+		double time;
+		long long total, done, cached, failed, bytes_read, bytes_written;
+		long long busy[NUM_STAGES];
+	};
+
+	Snapshot Take() const;
+	void Run();
+	void Report(bool final);
+
+	std::atomic<long long> total_;
+	std::string stats_file_;
+	bool console_;
+	int num_threads_;
+	double interval_;
+
+	std::atomic<long long> done_, cached_, failed_, bytes_read_, bytes_written_;
+	std::atomic<long long> queue_[NUM_STAGES];
+	std::atomic<long long> busy_[NUM_STAGES];
+
+	std::chrono::steady_clock::time_point start_;
+	Snapshot last_;
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable stop_cond_;
+	bool stop_;
+};
+
+
+#endif
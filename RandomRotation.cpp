@@ -33,8 +33,10 @@
 
 #include "RandomRotation.h"
 #include "Util.h"
+#include "TransformKernels.h"
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <cfloat>
 
 
 
@@ -124,6 +126,24 @@ void CircumTransImgRect(const cv::Size& img_size, const cv::Mat& transM, cv::Rec
 
 
 
+// Map of src coordinates for each pixel of dst from 3x3 homography from dst coordinates to src coordinates.
+// Rows of MAP_FLOAT whose error exceeds MAX_FLOAT_MAP_ERROR are computed again in double.
+void CreateMapFromInverse(const cv::Matx33d& inv_homography, const cv::Size& dst_size, cv::Mat& map_x, cv::Mat& map_y,
+	int map_precision, bool guardrail = true)
+{
+	map_x.create(dst_size, CV_32FC1);
+	map_y.create(dst_size, CV_32FC1);
+
+	for (int dy = 0; dy < dst_size.height; dy++){
+		float* map_x_ptr = map_x.ptr<float>(dy);
+		float* map_y_ptr = map_y.ptr<float>(dy);
+		if (map_precision == MAP_FLOAT && FloatMapRow(inv_homography, dy, dst_size.width, map_x_ptr, map_y_ptr, guardrail))
+			continue;
+		DoubleMapRow(inv_homography, dy, dst_size.width, map_x_ptr, map_y_ptr);
+	}
+}
+
+
 //! ͉摜Əo͉摜̍W̑Ή֌WvZ
 /*!
 \param[in] src_size ͉摜TCY
@@ -140,38 +160,77 @@ transMat
 (sx, sy, 0, 1)^T = transMat^(-1) * (dx*r, dy*r, Z*r)
 ƂȂB
 ArƂdxdyɑΉsxsy܂B
+r > 0 o͉摜̃J̑Oɂ_ƂȂB
 */
-void CreateMap(const cv::Size& src_size, const cv::Rect_<double>& dst_rect, const cv::Mat& transMat, cv::Mat& map_x, cv::Mat& map_y)
+void CreateMap(const cv::Size& src_size, const cv::Rect_<double>& dst_rect, const cv::Mat& transMat, cv::Mat& map_x, cv::Mat& map_y,
+	int map_precision, bool guardrail = true)
 {
-	map_x.create(dst_rect.size(), CV_32FC1);
-	map_y.create(dst_rect.size(), CV_32FC1);
-
 	double Z = transMat.at<double>(2, 3);
 
+	// r(sx, sy)(dx, dy)̎ˉeϊɂȂ̂ŁA3x3s߂
+	// Ŝ-inv(2,3)ŊA3sڂ1/rƂȂ悤ɂiJ̑OŐj
 	cv::Mat invTransMat = transMat.inv();	// ts
-	cv::Mat dst_pos(3, 1, CV_64FC1);	// o͉摜̍W
-	dst_pos.at<double>(2, 0) = Z;
-	for (int dy = 0; dy<map_x.rows; dy++){
-		dst_pos.at<double>(1, 0) = dst_rect.y + dy;
-		for (int dx = 0; dx<map_x.cols; dx++){
-			dst_pos.at<double>(0, 0) = dst_rect.x + dx;
-			cv::Mat rMat = -invTransMat(cv::Rect(3, 2, 1, 1)) / (invTransMat(cv::Rect(0, 2, 3, 1)) * dst_pos);
-			cv::Mat src_pos = invTransMat(cv::Rect(0, 0, 3, 2)) * dst_pos * rMat + invTransMat(cv::Rect(3, 0, 1, 2));
-			map_x.at<float>(dy, dx) = src_pos.at<double>(0, 0) + (float)src_size.width / 2;
-			map_y.at<float>(dy, dx) = src_pos.at<double>(1, 0) + (float)src_size.height / 2;
+	const double* inv0 = invTransMat.ptr<double>(0);
+	const double* inv1 = invTransMat.ptr<double>(1);
+	const double* inv2 = invTransMat.ptr<double>(2);
+	double center[2] = { (float)src_size.width / 2, (float)src_size.height / 2 };
+	const double* inv_rows[2] = { inv0, inv1 };
+	cv::Matx33d proj;	// o͉摜̂RW(X, Y, Z)͉摜Wւ̎ˉeϊ
+	for (int k = 0; k < 2; k++){
+		for (int j = 0; j < 3; j++){
+			proj(k, j) = inv_rows[k][j] - (inv_rows[k][3] + center[k]) * inv2[j] / inv2[3];
 		}
 	}
+	for (int j = 0; j < 3; j++){
+		proj(2, j) = -inv2[j] / inv2[3];
+	}
+
+	// (dx, dy, 1)(X, Y, Z)
+	cv::Matx33d dst_pos(1, 0, dst_rect.x, 0, 1, dst_rect.y, 0, 0, Z);
+	cv::Size map_size(cvRound(dst_rect.width), cvRound(dst_rect.height));
+	CreateMapFromInverse(proj * dst_pos, map_size, map_x, map_y, map_precision, guardrail);
 }
 
 
-void RotateImage(const cv::Mat& src, cv::Mat& dst, float yaw, float pitch, float roll,
-	float Z = 1000, int interpolation = cv::INTER_LINEAR, int boarder_mode = cv::BORDER_CONSTANT, const cv::Scalar& border_color = cv::Scalar(0, 0, 0))
+//! Transform four corners of rectangle with homography and get its circumscribed rectangle
+/*!
+\param[in] rect input rectangle
+\param[in] homography 3x3 homography matrix (CV_64FC1)
+\return circumscribed rectangle of transformed rectangle
+*/
+cv::Rect_<double> TransformRect(const cv::Rect& rect, const cv::Mat& homography)
+{
+	cv::Mat dstCoord = homography * Rect2Mat(rect);
+
+	double min_x = DBL_MAX, max_x = -DBL_MAX, min_y = DBL_MAX, max_y = -DBL_MAX;
+	for (int i = 0; i < 4; i++){
+		double x = dstCoord.at<double>(0, i) / dstCoord.at<double>(2, i);
+		double y = dstCoord.at<double>(1, i) / dstCoord.at<double>(2, i);
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+	}
+
+	return cv::Rect_<double>(min_x, min_y, max_x - min_x, max_y - min_y);
+}
+
+
+//! Compose 3D rotation of image and its perspective projection
+/*!
+\param[in] src_size input image size
+\param[out] rotMat 4x4 rotation/translation matrix (CV_64FC1)
+\param[out] transMat 3x3 homography from input image to projected coordinates (CV_64FC1)
+\param[out] CircumRect circumscribed rectangle of projected input image
+*/
+void ComposeRotation(const cv::Size& src_size, float yaw, float pitch, float roll, float Z,
+	cv::Mat& rotMat, cv::Mat& transMat, cv::Rect_<double>& CircumRect)
 {
 	// rotation matrix
 	cv::Mat rotMat_3x4;
 	composeExternalMatrix(yaw, pitch, roll, 0, 0, Z, rotMat_3x4);
 
-	cv::Mat rotMat = cv::Mat::eye(4, 4, rotMat_3x4.type());
+	rotMat = cv::Mat::eye(4, 4, rotMat_3x4.type());
 	rotMat_3x4.copyTo(rotMat(cv::Rect(0, 0, 4, 3)));
 
 	// From 2D coordinates to 3D coordinates
@@ -180,8 +239,8 @@ void RotateImage(const cv::Mat& src, cv::Mat& dst, float yaw, float pitch, float
 	invPerspMat.at<double>(0, 0) = 1;
 	invPerspMat.at<double>(1, 1) = 1;
 	invPerspMat.at<double>(3, 2) = 1;
-	invPerspMat.at<double>(0, 2) = -(double)src.cols / 2;
-	invPerspMat.at<double>(1, 2) = -(double)src.rows / 2;
+	invPerspMat.at<double>(0, 2) = -(double)src_size.width / 2;
+	invPerspMat.at<double>(1, 2) = -(double)src_size.height / 2;
 
 	// RWQW֓ϊ
 	cv::Mat perspMat = cv::Mat::zeros(3, 4, CV_64FC1);
@@ -190,13 +249,77 @@ void RotateImage(const cv::Mat& src, cv::Mat& dst, float yaw, float pitch, float
 	perspMat.at<double>(2, 2) = 1;
 
 	// WϊAo͉摜̍W͈͂擾
-	cv::Mat transMat = perspMat * rotMat * invPerspMat;
+	transMat = perspMat * rotMat * invPerspMat;
+	CircumTransImgRect(src_size, transMat, CircumRect);
+}
+
+
+// Homography of translation
+cv::Mat ShiftMat(double x, double y)
+{
+	cv::Mat shiftMat = cv::Mat::eye(3, 3, CV_64FC1);
+	shiftMat.at<double>(0, 2) = x;
+	shiftMat.at<double>(1, 2) = y;
+	return shiftMat;
+}
+
+
+cv::Mat ResizeHomography(const cv::Size_<double>& src_size, const cv::Size_<double>& dst_size)
+{
+	// cv::resize() aligns pixel centers: dst = (src + 0.5) * scale - 0.5
+	double sx = dst_size.width / src_size.width;
+	double sy = dst_size.height / src_size.height;
+	cv::Mat scaleMat = cv::Mat::eye(3, 3, CV_64FC1);
+	scaleMat.at<double>(0, 0) = sx;
+	scaleMat.at<double>(1, 1) = sy;
+	scaleMat.at<double>(0, 2) = 0.5 * sx - 0.5;
+	scaleMat.at<double>(1, 2) = 0.5 * sy - 0.5;
+	return scaleMat;
+}
+
+
+// Map of src coordinates for each pixel of dst
+void CreateMapFromHomography(const cv::Mat& homography, const cv::Size& dst_size, cv::Mat& map_x, cv::Mat& map_y, int map_precision)
+{
+	CreateMapFromInverse(cv::Matx33d(homography).inv(), dst_size, map_x, map_y, map_precision);
+}
+
+
+// Fold scale from grid_size to output_size into homography.
+// If output is smaller, source is shrunk to about the output scale by area averaging before sampling to avoid aliasing.
+// sample_homography is from the shrunk source to output. Returns false if output_size does not change the grid.
+bool ScaleToOutput(const cv::Size& grid_size, const cv::Size& src_size, const cv::Size& output_size,
+	cv::Mat& homography, cv::Size& prefilter_size, cv::Mat& sample_homography)
+{
+	prefilter_size = cv::Size();
+	sample_homography = homography;
+	if (output_size.width <= 0 || output_size.height <= 0 || output_size == grid_size)
+		return false;
+
+	homography = ResizeHomography(grid_size, output_size) * homography;
+	sample_homography = homography;
+
+	// Scale of the more minified axis, so that neither axis is sampled below the output scale
+	double scale = std::min((double)output_size.width / grid_size.width, (double)output_size.height / grid_size.height);
+	if (scale < 1){
+		prefilter_size.width = std::max(cvRound(src_size.width * scale), 1);
+		prefilter_size.height = std::max(cvRound(src_size.height * scale), 1);
+		sample_homography = homography * ResizeHomography(src_size, prefilter_size).inv();
+	}
+	return true;
+}
+
+
+void RotateImage(const cv::Mat& src, cv::Mat& dst, float yaw, float pitch, float roll,
+	float Z = 1000, int interpolation = cv::INTER_LINEAR, int boarder_mode = cv::BORDER_CONSTANT, const cv::Scalar& border_color = cv::Scalar(0, 0, 0))
+{
+	cv::Mat rotMat, transMat;
 	cv::Rect_<double> CircumRect;
-	CircumTransImgRect(src.size(), transMat, CircumRect);
+	ComposeRotation(src.size(), yaw, pitch, roll, Z, rotMat, transMat, CircumRect);
 
 	// o͉摜Ɠ͉摜̑Ή}bv쐬
 	cv::Mat map_x, map_y;
-	CreateMap(src.size(), CircumRect, rotMat, map_x, map_y);
+	CreateMap(src.size(), CircumRect, rotMat, map_x, map_y, MAP_FLOAT);
 	cv::remap(src, dst, map_x, map_y, interpolation, boarder_mode, border_color);
 }
 
@@ -217,6 +340,200 @@ cv::Rect ExpandRectForRotate(const cv::Rect& area)
 }
 
 
+// Area of source image which is rotated for target area
+cv::Rect RotationSourceRect(const cv::Size& src_size, const cv::Rect& area)
+{
+	cv::Rect rect = (area.width <= 0 || area.height <= 0) ? cv::Rect(0, 0, src_size.width, src_size.height) :
+		ExpandRectForRotate(area);
+	return util::TruncateRectKeepCenter(rect, src_size);
+}
+
+
+// Keep center of rotated image and crop the size of target area
+cv::Rect CropRectOfRotatedImage(const cv::Size& rot_size, const cv::Size& area_size)
+{
+	cv::Rect dst_area((rot_size.width - area_size.width) / 2, (rot_size.height - area_size.height) / 2, area_size.width, area_size.height);
+	return util::TruncateRectKeepCenter(dst_area, rot_size);
+}
+
+
+cv::Rect UnrotatedArea(const cv::Size& src_size, const cv::Rect& area)
+{
+	cv::Rect rect = RotationSourceRect(src_size, area);
+	cv::Size area_size = (area.width <= 0 || area.height <= 0) ? src_size : area.size();
+	cv::Rect dst_area = CropRectOfRotatedImage(rect.size(), area_size);
+	return cv::Rect(rect.x + dst_area.x, rect.y + dst_area.y, dst_area.width, dst_area.height);
+}
+
+
+// Area of projected coordinates which is cropped from rotated image
+cv::Rect_<double> RotationMapRect(const cv::Size& src_size, const cv::Size& area_size, float yaw, float pitch, float roll, float Z,
+	cv::Mat& rotMat, cv::Mat& transMat)
+{
+	cv::Rect_<double> CircumRect;
+	ComposeRotation(src_size, yaw, pitch, roll, Z, rotMat, transMat, CircumRect);
+
+	cv::Size rot_size = CircumRect.size();
+	cv::Rect dst_area = CropRectOfRotatedImage(rot_size, area_size);
+	return cv::Rect_<double>(CircumRect.x + dst_area.x, CircumRect.y + dst_area.y, dst_area.width, dst_area.height);
+}
+
+
+void PrepareRotationWarp(const cv::Size& src_size, const cv::Size& area_size, float yaw, float pitch, float roll,
+	RotationWarp& warp, bool fixed_point, float Z, const cv::Size& output_size, int map_precision)
+{
+	// Create map only for the area cropped from rotated image
+	cv::Mat rotMat, transMat;
+	cv::Rect_<double> map_rect = RotationMapRect(src_size, area_size, yaw, pitch, roll, Z, rotMat, transMat);
+	warp.homography = ShiftMat(-map_rect.x, -map_rect.y) * transMat;
+
+	cv::Mat map_x, map_y, sample_homography;
+	if (ScaleToOutput(map_rect.size(), src_size, output_size, warp.homography, warp.prefilter_size, sample_homography)){
+		// Map only for output grid
+		CreateMapFromHomography(sample_homography, output_size, map_x, map_y, map_precision);
+	}
+	else{
+		CreateMap(src_size, map_rect, rotMat, map_x, map_y, map_precision);
+	}
+	if (fixed_point){
+		cv::convertMaps(map_x, map_y, warp.map1, warp.map2, CV_16SC2);
+	}
+	else{
+		warp.map1 = map_x;
+		warp.map2 = map_y;
+	}
+
+	warp.yaw = yaw;
+	warp.pitch = pitch;
+	warp.roll = roll;
+}
+
+
+double MaxFloatMapError(const cv::Size& src_size, const cv::Size& area_size, float angle_step, bool guardrail, float Z)
+{
+	double max_error = 0;
+	for (float yaw = -180; yaw <= 180; yaw += angle_step){
+		for (float pitch = -180; pitch <= 180; pitch += angle_step){
+			for (float roll = -180; roll <= 180; roll += angle_step){
+				// Image seen edge-on has no map
+				if (std::abs(std::cos(pitch * CV_PI / 180)) < 1e-6 || std::abs(std::cos(roll * CV_PI / 180)) < 1e-6)
+					continue;
+
+				cv::Mat rotMat, transMat;
+				cv::Rect_<double> map_rect = RotationMapRect(src_size, area_size, yaw, pitch, roll, Z, rotMat, transMat);
+				cv::Size map_size(cvRound(map_rect.width), cvRound(map_rect.height));
+				if (map_size.width <= 0 || map_size.height <= 0)
+					continue;
+
+				// Reference from the homography of source to output, whose third row is the depth from the camera
+				cv::Matx33d inv_homography = cv::Matx33d(cv::Mat(ShiftMat(-map_rect.x, -map_rect.y) * transMat)).inv();
+				cv::Mat ref_x, ref_y;
+				CreateMapFromInverse(inv_homography, map_size, ref_x, ref_y, MAP_DOUBLE);
+
+				cv::Mat maps[2][2];
+				CreateMap(src_size, map_rect, rotMat, maps[0][0], maps[0][1], MAP_DOUBLE);
+				CreateMap(src_size, map_rect, rotMat, maps[1][0], maps[1][1], MAP_FLOAT, guardrail);
+				for (int m = 0; m < 2; m++){
+					for (int y = 0; y < map_size.height; y++){
+						const float* ref_x_ptr = ref_x.ptr<float>(y);
+						const float* ref_y_ptr = ref_y.ptr<float>(y);
+						const float* map_x_ptr = maps[m][0].ptr<float>(y);
+						const float* map_y_ptr = maps[m][1].ptr<float>(y);
+						for (int x = 0; x < map_size.width; x++){
+							// only pixels sampled from source (including the border of interpolation)
+							if (ref_x_ptr[x] < -1 || ref_x_ptr[x] > src_size.width || ref_y_ptr[x] < -1 || ref_y_ptr[x] > src_size.height)
+								continue;
+							max_error = std::max(max_error, (double)std::abs(map_x_ptr[x] - ref_x_ptr[x]));
+							max_error = std::max(max_error, (double)std::abs(map_y_ptr[x] - ref_y_ptr[x]));
+						}
+					}
+				}
+			}
+		}
+	}
+	return max_error;
+}
+
+
+void ApplyRotationWarp(const cv::Mat& src, const cv::Rect& src_rect, const RotationWarp& warp, cv::Mat& dst, cv::Mat& homography,
+	int interpolation, int boarder_mode, const cv::Scalar& boarder_color, MipPyramid* pyramid)
+{
+	if (warp.prefilter_size.area() > 0){
+		cv::Mat shrunk_src;
+		if (pyramid)
+			shrunk_src = pyramid->Shrunk(src_rect, warp.prefilter_size);
+		else
+			cv::resize(src(src_rect), shrunk_src, warp.prefilter_size, 0, 0, cv::INTER_AREA);
+		cv::remap(shrunk_src, dst, warp.map1, warp.map2, interpolation, boarder_mode, boarder_color);
+	}
+	else{
+		cv::remap(src(src_rect), dst, warp.map1, warp.map2, interpolation, boarder_mode, boarder_color);
+	}
+
+	// Homography from input image to output image
+	homography = warp.homography * ShiftMat(-src_rect.x, -src_rect.y);
+}
+
+
+void RotateImageArea(const cv::Mat& src, cv::Mat& dst, cv::Mat& homography, float yaw, float pitch, float roll, const cv::Rect& area,
+	float Z, int interpolation, int boarder_mode, const cv::Scalar& boarder_color, const cv::Size& output_size, MipPyramid* pyramid)
+{
+	cv::Rect rect = RotationSourceRect(src.size(), area);
+	cv::Size area_size = (area.width <= 0 || area.height <= 0) ? src.size() : area.size();
+
+	// Map generation and sampling in one pass without map buffers
+	if (boarder_mode == cv::BORDER_CONSTANT){
+		cv::Mat rotMat, transMat;
+		cv::Rect_<double> map_rect = RotationMapRect(rect.size(), area_size, yaw, pitch, roll, Z, rotMat, transMat);
+		cv::Mat rot_homography = ShiftMat(-map_rect.x, -map_rect.y) * transMat;
+
+		// Render only output grid with the scale folded into homography
+		cv::Size dst_size = map_rect.size();
+		cv::Size prefilter_size;
+		cv::Mat sample_homography;
+		if (ScaleToOutput(dst_size, rect.size(), output_size, rot_homography, prefilter_size, sample_homography))
+			dst_size = output_size;
+
+		cv::Mat sample_src = src(rect);
+		if (prefilter_size.area() > 0 && pyramid){
+			sample_src = pyramid->Shrunk(rect, prefilter_size);
+		}
+		else if (prefilter_size.area() > 0){
+			cv::Mat shrunk_src;
+			cv::resize(sample_src, shrunk_src, prefilter_size, 0, 0, cv::INTER_AREA);
+			sample_src = shrunk_src;
+		}
+		if (WarpPerspectiveFused(sample_src, dst, dst_size, sample_homography, interpolation, boarder_color)){
+			homography = rot_homography * ShiftMat(-rect.x, -rect.y);
+			return;
+		}
+	}
+
+	RotationWarp warp;
+	PrepareRotationWarp(rect.size(), area_size, yaw, pitch, roll, warp, false, Z, output_size);
+	ApplyRotationWarp(src, rect, warp, dst, homography, interpolation, boarder_mode, boarder_color, pyramid);
+}
+
+
+cv::Mat RotationHomography(const cv::Size& src_size, const cv::Rect& area, float yaw, float pitch, float roll,
+	cv::Rect& src_rect, cv::Size& dst_size, float Z, const cv::Size& output_size)
+{
+	src_rect = RotationSourceRect(src_size, area);
+	cv::Size area_size = (area.width <= 0 || area.height <= 0) ? src_size : area.size();
+
+	cv::Mat rotMat, transMat;
+	cv::Rect_<double> map_rect = RotationMapRect(src_rect.size(), area_size, yaw, pitch, roll, Z, rotMat, transMat);
+	cv::Mat homography = ShiftMat(-map_rect.x, -map_rect.y) * transMat;
+
+	dst_size = map_rect.size();
+	if (output_size.width > 0 && output_size.height > 0 && output_size != dst_size){
+		homography = ResizeHomography(dst_size, output_size) * homography;
+		dst_size = output_size;
+	}
+	return homography * ShiftMat(-src_rect.x, -src_rect.y);
+}
+
+
 void RandomRotateImage(const cv::Mat& src, cv::Mat& dst, float yaw_sigma, float pitch_sigma, float roll_sigma, const cv::Rect& area, cv::RNG& rng,
 	float Z, int interpolation, int boarder_mode, const cv::Scalar& boarder_color)
 {
@@ -227,15 +544,41 @@ void RandomRotateImage(const cv::Mat& src, cv::Mat& dst, float yaw_sigma, float
 	//double pitch = rng.uniform(-pitch_range / 2, pitch_range / 2);
 	//double roll = rng.uniform(-roll_range / 2, roll_range / 2);
 
-	cv::Rect rect = (area.width <= 0 || area.height <= 0) ? cv::Rect(0, 0, src.cols, src.rows) : 
-		ExpandRectForRotate(area);
-	rect = util::TruncateRectKeepCenter(rect, src.size());
+	cv::Mat homography;
+	RotateImageArea(src, dst, homography, yaw, pitch, roll, area, Z, interpolation, boarder_mode, boarder_color);
+}
 
-	cv::Mat rot_img;
-	RotateImage(src(rect).clone(), rot_img, yaw, pitch, roll, Z, interpolation, boarder_mode, boarder_color);
 
-	cv::Rect dst_area((rot_img.cols - area.width) / 2, (rot_img.rows - area.height) / 2, area.width, area.height);
-	dst_area = util::TruncateRectKeepCenter(dst_area, rot_img.size());
-	dst = rot_img(dst_area).clone();
+void RandomRotateImage(const cv::Mat& src, cv::Mat& dst, float yaw_sigma, float pitch_sigma, float roll_sigma, const cv::Rect& area)
+{
+	cv::RNG rng;
+	RandomRotateImage(src, dst, yaw_sigma, pitch_sigma, roll_sigma, area, rng);
 }
 
+
+void RandomRotateImageWithRects(const cv::Mat& src, cv::Mat& dst, const std::vector<cv::Rect>& rects, std::vector<cv::Rect_<double>>& dst_rects,
+	float yaw_sigma, float pitch_sigma, float roll_sigma, cv::RNG& rng,
+	float Z, int interpolation, int boarder_mode, const cv::Scalar& boarder_color)
+{
+	double yaw = rng.gaussian(yaw_sigma);
+	double pitch = rng.gaussian(pitch_sigma);
+	double roll = rng.gaussian(roll_sigma);
+
+	// Rotate whole image once for all rectangles
+	cv::Mat homography;
+	RotateImageArea(src, dst, homography, yaw, pitch, roll, cv::Rect(), Z, interpolation, boarder_mode, boarder_color);
+
+	// Apply the same homography to the corners of each rectangle
+	dst_rects.clear();
+	for (int i = 0; i < rects.size(); i++){
+		dst_rects.push_back(TransformRect(rects[i], homography));
+	}
+}
+
+
+void RandomRotateImageWithRects(const cv::Mat& src, cv::Mat& dst, const std::vector<cv::Rect>& rects, std::vector<cv::Rect_<double>>& dst_rects,
+	float yaw_sigma, float pitch_sigma, float roll_sigma)
+{
+	cv::RNG rng;
+	RandomRotateImageWithRects(src, dst, rects, dst_rects, yaw_sigma, pitch_sigma, roll_sigma, rng);
+}
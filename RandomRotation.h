@@ -36,8 +36,111 @@
 
 #include <opencv2/imgproc/imgproc.hpp>
 
-void RandomRotateImage(const cv::Mat& src, cv::Mat& dst, float yaw_range, float pitch_range, float roll_range, const cv::Rect& area = cv::Rect(-1,-1, 0, 0), cv::RNG& rng = cv::RNG(),
+class MipPyramid;
+
+void RandomRotateImage(const cv::Mat& src, cv::Mat& dst, float yaw_range, float pitch_range, float roll_range, const cv::Rect& area, cv::RNG& rng,
+	float Z = 1000, int interpolation = cv::INTER_LINEAR, int boarder_mode = cv::BORDER_CONSTANT, const cv::Scalar& boarder_color = cv::Scalar(0, 0, 0));
+//! RandomRotateImage() with random numbers of cv::RNG()
+void RandomRotateImage(const cv::Mat& src, cv::Mat& dst, float yaw_range, float pitch_range, float roll_range, const cv::Rect& area = cv::Rect(-1,-1, 0, 0));
+
+//! Precomputed maps of rotation for fixed source size, area size, and angles
+struct RotationWarp
+{
+	float yaw, pitch, roll;
+	cv::Mat map1, map2;		//!< maps for cv::remap()
+	cv::Mat homography;		//!< 3x3 homography from source coordinates to output coordinates (CV_64FC1)
+	cv::Size prefilter_size;	//!< size to which source is shrunk by area averaging before remap (empty: no prefilter)
+};
+
+//! Precision of computing maps for cv::remap()
+enum MapPrecision
+{
+	MAP_DOUBLE,	//!< every pixel in double (reference)
+	MAP_FLOAT,	//!< stepped in float along rows. Rows whose error may reach 1/32 pixel are computed in double.
+};
+
+//! 3x3 homography of cv::resize() from src_size to dst_size (CV_64FC1)
+cv::Mat ResizeHomography(const cv::Size_<double>& src_size, const cv::Size_<double>& dst_size);
+
+//! Area of source image which is rotated for target area (expanded for rotation and truncated)
+cv::Rect RotationSourceRect(const cv::Size& src_size, const cv::Rect& area);
+
+//! Precompute maps to rotate source image and crop the size of area around the center
+/*!
+\param[in] src_size size of source image (area returned by RotationSourceRect())
+\param[in] area_size size of output image
+\param[out] warp precomputed maps and homography
+\param[in] fixed_point convert maps to fixed point (faster remap, smaller memory) for repeated use
+\param[in] output_size size of output image. The area is scaled to this size in the maps (empty: size of area)
+\param[in] map_precision MAP_FLOAT or MAP_DOUBLE
+*/
+void PrepareRotationWarp(const cv::Size& src_size, const cv::Size& area_size, float yaw, float pitch, float roll,
+	RotationWarp& warp, bool fixed_point = false, float Z = 1000, const cv::Size& output_size = cv::Size(),
+	int map_precision = MAP_FLOAT);
+
+//! Largest coordinate error of maps over yaw, pitch, and roll
+/*!
+Maps of MAP_DOUBLE and MAP_FLOAT are compared with the maps from the homography of source to output.
+Yaw, pitch, and roll are checked in [-180, 180] at every angle_step degrees, except the angles at which the image is seen edge-on.
+Every pixel is compared, including the pixels between the ends and the middle of blocks which the guardrail checks.
+Only pixels mapped into the source by the reference are compared, so that a pixel mapped to the border by mistake is also an error.
+\param[in] src_size size of source image
+\param[in] area_size size of output image
+\param[in] angle_step step of angles (degree)
+\param[in] guardrail compute rows again in double as warps do. If false, it measures the error of the float path itself.
+\return largest error (pixel)
+*/
+double MaxFloatMapError(const cv::Size& src_size, const cv::Size& area_size, float angle_step, bool guardrail, float Z = 1000);
+
+//! Rotate src_rect of src with precomputed maps
+/*!
+\param[out] homography 3x3 homography from src coordinates to dst coordinates (CV_64FC1)
+\param[in,out] pyramid mip pyramid of src shared among samples (optional). Source shrunk by the prefilter is kept in it.
+*/
+void ApplyRotationWarp(const cv::Mat& src, const cv::Rect& src_rect, const RotationWarp& warp, cv::Mat& dst, cv::Mat& homography,
+	int interpolation = cv::INTER_LINEAR, int boarder_mode = cv::BORDER_CONSTANT, const cv::Scalar& boarder_color = cv::Scalar(0, 0, 0),
+	MipPyramid* pyramid = NULL);
+
+//! Rotate image around the center of area and crop the size of area
+/*!
+\param[in] src input image
+\param[out] dst rotated image which has the size of area (or output_size)
+\param[out] homography 3x3 homography from src coordinates to dst coordinates (CV_64FC1)
+\param[in] area target area on src. Whole image is used if area is empty.
+\param[in] output_size size of dst. The area is rendered directly at this size (empty: size of area)
+\param[in,out] pyramid mip pyramid of src shared among samples (optional). Source shrunk by the prefilter is kept in it.
+*/
+void RotateImageArea(const cv::Mat& src, cv::Mat& dst, cv::Mat& homography, float yaw, float pitch, float roll, const cv::Rect& area,
+	float Z = 1000, int interpolation = cv::INTER_LINEAR, int boarder_mode = cv::BORDER_CONSTANT, const cv::Scalar& boarder_color = cv::Scalar(0, 0, 0),
+	const cv::Size& output_size = cv::Size(), MipPyramid* pyramid = NULL);
+
+//! Homography of RotateImageArea() from src coordinates to dst coordinates (CV_64FC1)
+/*!
+\param[out] src_rect area of src which is rotated
+\param[out] dst_size size of dst
+*/
+cv::Mat RotationHomography(const cv::Size& src_size, const cv::Rect& area, float yaw, float pitch, float roll,
+	cv::Rect& src_rect, cv::Size& dst_size, float Z = 1000, const cv::Size& output_size = cv::Size());
+
+//! Area of src which RotateImageArea() outputs when all angles are zero
+cv::Rect UnrotatedArea(const cv::Size& src_size, const cv::Rect& area);
+
+//! Rotate whole image randomly and transform rectangles on it with the same homography
+/*!
+\param[in] src input image
+\param[out] dst rotated image which has the same size as src
+\param[in] rects rectangles on src
+\param[out] dst_rects circumscribed rectangles of transformed rects on dst (not truncated)
+*/
+void RandomRotateImageWithRects(const cv::Mat& src, cv::Mat& dst, const std::vector<cv::Rect>& rects, std::vector<cv::Rect_<double>>& dst_rects,
+	float yaw_sigma, float pitch_sigma, float roll_sigma, cv::RNG& rng,
 	float Z = 1000, int interpolation = cv::INTER_LINEAR, int boarder_mode = cv::BORDER_CONSTANT, const cv::Scalar& boarder_color = cv::Scalar(0, 0, 0));
+//! RandomRotateImageWithRects() with random numbers of cv::RNG()
+void RandomRotateImageWithRects(const cv::Mat& src, cv::Mat& dst, const std::vector<cv::Rect>& rects, std::vector<cv::Rect_<double>>& dst_rects,
+	float yaw_sigma, float pitch_sigma, float roll_sigma);
+
+//! Transform four corners of rectangle with homography and get its circumscribed rectangle
+cv::Rect_<double> TransformRect(const cv::Rect& rect, const cv::Mat& homography);
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "Scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+
+int ResolveNumThreads(int num_threads)
+{
+	if (num_threads > 0)
+		return num_threads;
+	return std::max((int)std::thread::hardware_concurrency(), 1);
+}
+
+
+// Orders task indices by decreasing cost
+struct CostGreater
+{
+	explicit CostGreater(const std::vector<double>& costs) : costs_(costs){}
+	bool operator()(int a, int b) const { return costs_[a] > costs_[b]; }
+
+	const std::vector<double>& costs_;
+};
+
+
+// State shared by threads of RunTasksByCost()
+class TaskQueue
+{
+public:
+	TaskQueue(const std::vector<int>& order, TaskBody& body) : order_(order), body_(body), next_(0), stop_(false){}
+
+	void Work()
+	{
+		while (!stop_){
+			size_t n = next_++;
+			if (n >= order_.size())
+				break;
+			try{
+				body_(order_[n]);
+			}
+			catch (...){
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (!error_)
+					error_ = std::current_exception();
+				stop_ = true;
+			}
+		}
+	}
+
+	void RethrowError()
+	{
+		if (error_)
+			std::rethrow_exception(error_);
+	}
+
+private:
+	const std::vector<int>& order_;
+	TaskBody& body_;
+	std::atomic<size_t> next_;
+	std::atomic<bool> stop_;
+	std::mutex mutex_;
+	std::exception_ptr error_;
+};
+
+
+void RunTasksByCost(const std::vector<double>& costs, int num_threads, TaskBody& body)
+{
+	std::vector<int> order(costs.size());
+	for (int i = 0; i < order.size(); i++){
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), CostGreater(costs));
+
+	TaskQueue queue(order, body);
+	num_threads = std::min(ResolveNumThreads(num_threads), std::max((int)order.size(), 1));
+	std::vector<std::thread> threads;
+	for (int i = 1; i < num_threads; i++){
+		threads.push_back(std::thread(&TaskQueue::Work, &queue));
+	}
+	queue.Work();
+	for (int i = 0; i < threads.size(); i++){
+		threads[i].join();
+	}
+	queue.RethrowError();
+}
+
+
+TaskPool::TaskPool(int num_threads, TaskBody& body) : body_(body), closed_(false), stop_(false)
+{
+	num_threads = ResolveNumThreads(num_threads);
+	for (int i = 0; i < num_threads; i++){
+		threads_.push_back(std::thread(&TaskPool::Work, this));
+	}
+}
+
+
+TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	added_.notify_all();
+	Join();
+}
+
+
+void TaskPool::Add(int task, double cost)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		QueuedTask queued;
+		queued.cost = cost;
+		queued.task = task;
+		queue_.push(queued);
+	}
+	added_.notify_one();
+}
+
+
+void TaskPool::Finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+	}
+	added_.notify_all();
+	Join();
+	if (error_)
+		std::rethrow_exception(error_);
+}
+
+
+void TaskPool::Work()
+{
+	for (;;){
+		int task;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			while (!stop_ && !closed_ && queue_.empty()){
+				added_.wait(lock);
+			}
+			// Stopped, or finished and no task is left
+			if (stop_ || queue_.empty())
+				break;
+			task = queue_.top().task;
+			queue_.pop();
+		}
+
+		try{
+			body_(task);
+		}
+		catch (...){
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (!error_)
+					error_ = std::current_exception();
+				stop_ = true;
+			}
+			added_.notify_all();
+		}
+	}
+}
+
+
+void TaskPool::Join()
+{
+	for (int i = 0; i < threads_.size(); i++){
+		if (threads_[i].joinable())
+			threads_[i].join();
+	}
+}
+
+
+void MemoryBudget::StartTask(long long bytes)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (budget_ > 0 && running_ > 0 && in_flight_ + bytes > budget_){
+		released_.wait(lock);
+	}
+	in_flight_ += bytes;
+	running_++;
+}
+
+
+void MemoryBudget::FinishTask(long long bytes, long long kept)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		in_flight_ -= bytes - kept;
+		running_--;
+	}
+	released_.notify_all();
+}
+
+
+void MemoryBudget::Release(long long bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		in_flight_ -= bytes;
+	}
+	released_.notify_all();
+}
@@ -0,0 +1,171 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __SCHEDULER__
+#define __SCHEDULER__
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+//! Body of tasks run by RunTasksByCost()
+class TaskBody
+{
+public:
+	virtual ~TaskBody(){}
+
+	//! Run task. It is called from several threads at the same time.
+	virtual void operator()(int task) = 0;
+};
+
+//! Number of threads to be used (num_threads, or number of hardware threads if it is 0)
+int ResolveNumThreads(int num_threads);
+
+//! Run tasks on a pool of threads, largest estimated cost first
+/*!
+Each thread takes the next task when it finishes one, so that expensive tasks are started early
+and do not run alone at the end (longest processing time first).
+Tasks of the same cost are started in the order of index.
+If a task throws an exception, no more task is started and the first exception is rethrown after all threads stop.
+\param[in] costs estimated cost of each task
+\param[in] num_threads number of threads (0: number of hardware threads). Tasks run on the calling thread if it is 1.
+\param[in] body body of tasks
+*/
+void RunTasksByCost(const std::vector<double>& costs, int num_threads, TaskBody& body);
+
+//! Pool of threads which runs tasks added while it runs, largest estimated cost first among queued tasks
+/*!
+Threads wait while the queue is empty, so that tasks added later (e.g. images found by a running scan)
+are started as soon as a thread is free, without waiting for the tasks added before them.
+Tasks of the same cost are started in the order of index.
+If a task throws an exception, no more task is started and the first exception is rethrown by Finish().
+*/
+class TaskPool
+{
+public:
+	//! Start threads
+	/*!
+	\param[in] num_threads number of threads (0: number of hardware threads)
+	\param[in] body body of tasks
+	*/
+	TaskPool(int num_threads, TaskBody& body);
+
+	//! Stop threads. Tasks which are not started are discarded.
+	~TaskPool();
+
+	//! Queue task. It can be called from any thread until Finish().
+	void Add(int task, double cost);
+
+	//! Wait until all queued tasks are finished, and stop threads
+	void Finish();
+
+private:
+	struct QueuedTask
+	{
+		double cost;
+		int task;
+
+		// Lower priority: smaller cost, or larger index of the same cost
+		bool operator<(const QueuedTask& other) const
+		{
+			return cost < other.cost || (cost == other.cost && task > other.task);
+		}
+	};
+
+	void Work();
+	void Join();
+
+	TaskBody& body_;
+	std::priority_queue<QueuedTask> queue_;
+	bool closed_;		// no more task is added
+	bool stop_;			// a task threw an exception, or the pool is destroyed
+	std::exception_ptr error_;
+	std::vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable added_;
+};
+
+//! Budget of bytes of buffers in flight
+/*!
+A task waits at start while its bytes and the bytes in flight exceed the budget, so that new tasks are throttled near the cap.
+A task starts without waiting if no other task is running, so that tasks always progress and a task larger than the budget runs alone.
+Bytes of a buffer shared by following tasks (e.g. source image) can be kept at the end of task and released later.
+Budget 0 is unlimited.
+*/
+class MemoryBudget
+{
+public:
+	explicit MemoryBudget(long long budget) : budget_(budget), in_flight_(0), running_(0){}
+
+	bool Enabled() const { return budget_ > 0; }
+
+	//! Whether bytes alone exceed the budget
+	bool Exceeds(long long bytes) const { return budget_ > 0 && bytes > budget_; }
+
+	//! Wait until bytes fit in the budget, and start task which uses them
+	void StartTask(long long bytes);
+
+	//! Finish task and release its bytes except kept ones
+	void FinishTask(long long bytes, long long kept = 0);
+
+	//! Release bytes kept by FinishTask()
+	void Release(long long bytes);
+
+	//! Task in scope (finished also by exception)
+	class Task
+	{
+	public:
+		Task(MemoryBudget& budget, long long bytes, long long kept = 0) : budget_(budget), bytes_(bytes), kept_(kept)
+		{
+			budget_.StartTask(bytes_);
+		}
+		~Task() { budget_.FinishTask(bytes_, kept_); }
+
+	private:
+		MemoryBudget& budget_;
+		long long bytes_, kept_;
+	};
+
+private:
+	long long budget_;
+	long long in_flight_;
+	int running_;
+	std::mutex mutex_;
+	std::condition_variable released_;
+};
+
+
+#endif
@@ -0,0 +1,575 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#include "TransformKernels.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+
+// Ratio of maximum pixel value to 8 bit scale
+double DepthScale(int depth)
+{
+	return (depth == CV_16U) ? 65535.0 / 255.0 : 1.0;
+}
+
+
+bool IsSupportedImageType(int type)
+{
+	return type == CV_8UC1 || type == CV_8UC3 || type == CV_8UC4 || type == CV_16UC1;
+}
+
+
+// Largest coordinate error (pixel) of float maps against double.
+// It is the resolution of fixed point maps of cv::convertMaps() (INTER_BITS = 5), so that error under it does not change warped image.
+const double MAX_FLOAT_MAP_ERROR = 1.0 / 32;
+
+// Number of pixels stepped in float from a start computed in double
+const int FLOAT_MAP_BLOCK = 64;
+
+
+// Row of map in double
+void DoubleMapRow(const cv::Matx33d& h, int dy, int width, float* map_x_ptr, float* map_y_ptr)
+{
+	for (int dx = 0; dx < width; dx++){
+		double w = h(2, 0) * dx + h(2, 1) * dy + h(2, 2);
+		// behind the camera: out of source
+		map_x_ptr[dx] = (w > 0) ? (h(0, 0) * dx + h(0, 1) * dy + h(0, 2)) / w : -1;
+		map_y_ptr[dx] = (w > 0) ? (h(1, 0) * dx + h(1, 1) * dy + h(1, 2)) / w : -1;
+	}
+}
+
+
+// Whether map at dx differs from double by more than MAX_FLOAT_MAP_ERROR
+bool FloatMapError(const cv::Matx33d& h, int dx, int dy, const float* map_x_ptr, const float* map_y_ptr)
+{
+	double w = h(2, 0) * dx + h(2, 1) * dy + h(2, 2);
+	if (w <= 0)
+		return map_x_ptr[dx] != -1 || map_y_ptr[dx] != -1;
+	double ex = (h(0, 0) * dx + h(0, 1) * dy + h(0, 2)) / w - map_x_ptr[dx];
+	double ey = (h(1, 0) * dx + h(1, 1) * dy + h(1, 2)) / w - map_y_ptr[dx];
+	return !(std::abs(ex) < MAX_FLOAT_MAP_ERROR && std::abs(ey) < MAX_FLOAT_MAP_ERROR);
+}
+
+
+// Row of map in float.
+// Numerators and denominator are linear along the row, so that they are stepped from the start of each block computed in double.
+// Error is usually the largest at the ends of a block (the end of steps, or the smallest denominator).
+// If guardrail is set, the ends and the middle of each block are compared with double. Returns false if the error is too large.
+bool FloatMapRow(const cv::Matx33d& h, int dy, int width, float* map_x_ptr, float* map_y_ptr, bool guardrail)
+{
+	const float step_x = (float)h(0, 0);
+	const float step_y = (float)h(1, 0);
+	const float step_w = (float)h(2, 0);
+	for (int x0 = 0; x0 < width; x0 += FLOAT_MAP_BLOCK){
+		int n = std::min(FLOAT_MAP_BLOCK, width - x0);
+		const float start_x = (float)(h(0, 0) * x0 + h(0, 1) * dy + h(0, 2));
+		const float start_y = (float)(h(1, 0) * x0 + h(1, 1) * dy + h(1, 2));
+		const float start_w = (float)(h(2, 0) * x0 + h(2, 1) * dy + h(2, 2));
+		float* bx = map_x_ptr + x0;
+		float* by = map_y_ptr + x0;
+		for (int i = 0; i < n; i++){
+			float w = start_w + step_w * i;
+			float inv_w = 1.0f / w;
+			// behind the camera: out of source
+			bx[i] = (w > 0) ? (start_x + step_x * i) * inv_w : -1.0f;
+			by[i] = (w > 0) ? (start_y + step_y * i) * inv_w : -1.0f;
+		}
+		if (guardrail && (FloatMapError(h, x0, dy, map_x_ptr, map_y_ptr) || FloatMapError(h, x0 + n / 2, dy, map_x_ptr, map_y_ptr) ||
+			FloatMapError(h, x0 + n - 1, dy, map_x_ptr, map_y_ptr)))
+			return false;
+	}
+	return true;
+}
+
+
+// Whether warp supports type of image and interpolation
+bool IsSupportedWarp(int type, int interpolation)
+{
+	return IsSupportedImageType(type) && (interpolation == cv::INTER_NEAREST || interpolation == cv::INTER_LINEAR);
+}
+
+
+// Sample src at dst pixels in dst_rect mapped by inv_h (dst coordinates to src coordinates).
+// Map of the rect is computed in float blocks, converted to fixed point, and sampled by cv::remap(),
+// whose kernels are vectorized. Neighbors out of src are border value.
+void WarpRect(const cv::Mat& src, cv::Mat& dst, const cv::Rect& dst_rect, const cv::Matx33d& inv_h,
+	int interpolation, const cv::Scalar& border_value)
+{
+	// Homography from coordinates in dst_rect
+	cv::Matx33d h = inv_h * cv::Matx33d(1, 0, dst_rect.x, 0, 1, dst_rect.y, 0, 0, 1);
+
+	cv::Mat map_x(dst_rect.size(), CV_32FC1), map_y(dst_rect.size(), CV_32FC1);
+	for (int dy = 0; dy < dst_rect.height; dy++){
+		float* map_x_ptr = map_x.ptr<float>(dy);
+		float* map_y_ptr = map_y.ptr<float>(dy);
+		if (!FloatMapRow(h, dy, dst_rect.width, map_x_ptr, map_y_ptr, true))
+			DoubleMapRow(h, dy, dst_rect.width, map_x_ptr, map_y_ptr);
+	}
+
+	cv::Mat map1, map2;
+	cv::convertMaps(map_x, map_y, map1, map2, CV_16SC2, interpolation == cv::INTER_NEAREST);
+	cv::Mat dst_roi = dst(dst_rect);
+	cv::remap(src, dst_roi, map1, map2, interpolation, cv::BORDER_CONSTANT, border_value);
+}
+
+
+// Inverse of 3x3 homography as Matx
+cv::Matx33d InverseHomography(const cv::Mat& homography)
+{
+	cv::Mat inv_mat = homography.inv();
+	return cv::Matx33d(inv_mat.ptr<double>(0));
+}
+
+
+// Size of tile which samples one mip level, and height of band of parallel warp
+const int MIP_TILE_SIZE = 32;
+
+// Output which has at least this number of pixels is split into bands warped in parallel by the threads of OpenCV,
+// so that a single large sample does not leave the other cores idle (DataAugmentation() limits them to one
+// while it runs several threads of its own)
+const int PARALLEL_WARP_AREA = 1 << 20;
+
+
+// Warp bands of MIP_TILE_SIZE rows in parallel
+class WarpBandBody : public cv::ParallelLoopBody
+{
+public:
+	WarpBandBody(const cv::Mat& src, cv::Mat& dst, const cv::Matx33d& inv_h, int interpolation, const cv::Scalar& border_value) :
+		src_(src), dst_(dst), inv_h_(inv_h), interpolation_(interpolation), border_value_(border_value){}
+
+	void operator()(const cv::Range& range) const
+	{
+		for (int band = range.start; band < range.end; band++){
+			int y = band * MIP_TILE_SIZE;
+			cv::Rect rect(0, y, dst_.cols, std::min(MIP_TILE_SIZE, dst_.rows - y));
+			WarpRect(src_, dst_, rect, inv_h_, interpolation_, border_value_);
+		}
+	}
+
+private:
+	const cv::Mat& src_;
+	cv::Mat& dst_;
+	cv::Matx33d inv_h_;
+	int interpolation_;
+	cv::Scalar border_value_;
+};
+
+
+bool WarpPerspectiveFused(const cv::Mat& src, cv::Mat& dst, const cv::Size& dst_size, const cv::Mat& homography,
+	int interpolation, const cv::Scalar& border_value)
+{
+	if (!IsSupportedWarp(src.type(), interpolation))
+		return false;
+
+	dst.create(dst_size, src.type());
+	cv::Matx33d inv_h = InverseHomography(homography);
+	if (dst_size.area() >= PARALLEL_WARP_AREA){
+		int num_bands = (dst_size.height + MIP_TILE_SIZE - 1) / MIP_TILE_SIZE;
+		cv::parallel_for_(cv::Range(0, num_bands), WarpBandBody(src, dst, inv_h, interpolation, border_value));
+	}
+	else{
+		WarpRect(src, dst, cv::Rect(0, 0, dst_size.width, dst_size.height), inv_h, interpolation, border_value);
+	}
+	return true;
+}
+
+
+// Maximum number of mip levels
+const int MAX_MIP_LEVEL = 16;
+
+
+MipPyramid::MipPyramid(const cv::Mat& img) : MipPyramid(img, cv::Point(), img.size(), NULL)
+{
+}
+
+
+MipPyramid::MipPyramid(const cv::Mat& region, const cv::Point& origin, const cv::Size& image_size, MipRegionLoader* loader) :
+	region_(origin.x, origin.y, region.cols, region.rows), loader_(loader), max_level_(0), region_img_(region)
+{
+	levels_.push_back(region);
+	origins_.push_back(origin);
+	sizes_.push_back(image_size);
+
+	int width = image_size.width, height = image_size.height;
+	while (width >= 2 && height >= 2 && max_level_ < MAX_MIP_LEVEL){
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		sizes_.push_back(cv::Size(width, height));
+		max_level_++;
+	}
+}
+
+
+const cv::Mat& MipPyramid::Level(int level)
+{
+	cv::Point origin;
+	return Level(level, origin);
+}
+
+
+const cv::Mat& MipPyramid::Level(int level, cv::Point& origin)
+{
+	level = std::min(std::max(level, 0), max_level_);
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (levels_.size() <= level){
+		levels_.resize(level + 1);
+		origins_.resize(level + 1);
+	}
+	if (levels_[level].empty() && level > 0)
+		Build(level);
+	origin = origins_[level];
+	return levels_[level];
+}
+
+
+// Number of results of MipPyramid::Shrunk() kept
+const int MAX_SHRUNK_IMAGES = 4;
+
+
+cv::Mat MipPyramid::Shrunk(const cv::Rect& rect, const cv::Size& size)
+{
+	{
+		std::lock_guard<std::mutex> lock(shrunk_mutex_);
+		for (int i = 0; i < shrunk_.size(); i++){
+			if (shrunk_[i].rect == rect && shrunk_[i].size == size)
+				return shrunk_[i].img;
+		}
+	}
+
+	// Resized without lock. Threads which miss the same rect at once resize it separately.
+	ShrunkImage shrunk;
+	shrunk.rect = rect;
+	shrunk.size = size;
+	cv::resize(region_img_(rect), shrunk.img, size, 0, 0, cv::INTER_AREA);
+
+	std::lock_guard<std::mutex> lock(shrunk_mutex_);
+	shrunk_.push_back(shrunk);
+	if (shrunk_.size() > MAX_SHRUNK_IMAGES)
+		shrunk_.pop_front();
+	return shrunk.img;
+}
+
+
+// Region of level n - 1 which cv::pyrDown() reads for rect of level n (5 taps around 2x)
+cv::Rect PyrDownSourceRect(const cv::Rect& rect)
+{
+	int x1 = rect.x * 2 - 2, y1 = rect.y * 2 - 2;
+	int x2 = (rect.x + rect.width) * 2 + 1, y2 = (rect.y + rect.height) * 2 + 1;
+	return cv::Rect(x1, y1, x2 - x1, y2 - y1);
+}
+
+
+// cv::pyrDown() of src at src_origin on level n - 1, cropped to rect of level n.
+// Pixels are the same as level n of whole image where src covers their taps, or the taps are cut by the edges of whole image.
+cv::Mat PyrDownRegion(const cv::Mat& src, const cv::Point& src_origin, const cv::Rect& rect, cv::Point& origin)
+{
+	// Crop starts at even position, so that pixels of the result are on the grid of level n
+	cv::Rect crop = PyrDownSourceRect(rect) & cv::Rect(src_origin.x, src_origin.y, src.cols, src.rows);
+	if (crop.x % 2 != 0){
+		crop.x++;
+		crop.width--;
+	}
+	if (crop.y % 2 != 0){
+		crop.y++;
+		crop.height--;
+	}
+	if (crop.width <= 0 || crop.height <= 0){
+		origin = rect.tl();
+		return cv::Mat();
+	}
+
+	cv::Mat down;
+	cv::pyrDown(src(cv::Rect(crop.x - src_origin.x, crop.y - src_origin.y, crop.width, crop.height)), down);
+	cv::Point down_origin(crop.x / 2, crop.y / 2);
+	cv::Rect result = rect & cv::Rect(down_origin.x, down_origin.y, down.cols, down.rows);
+	origin = result.tl();
+	if (result.width <= 0 || result.height <= 0)
+		return cv::Mat();
+	if (result.size() == down.size())
+		return down;
+	return down(cv::Rect(result.x - down_origin.x, result.y - down_origin.y, result.width, result.height));
+}
+
+
+// Build level from the highest built level which covers the taps of cv::pyrDown() down to the level,
+// or from the region of level 0 loaded by the loader. Pyramid of whole image builds each level from the previous one.
+void MipPyramid::Build(int level)
+{
+	// Region of each level needed for the region of level 0 on the level
+	std::vector<cv::Rect> need(level + 1);
+	int scale = 1 << level;
+	int x1 = region_.x / scale, y1 = region_.y / scale;
+	int x2 = (region_.x + region_.width + scale - 1) / scale, y2 = (region_.y + region_.height + scale - 1) / scale;
+	need[level] = cv::Rect(x1, y1, x2 - x1, y2 - y1) & cv::Rect(0, 0, sizes_[level].width, sizes_[level].height);
+	for (int n = level; n > 0; n--){
+		need[n - 1] = PyrDownSourceRect(need[n]) & cv::Rect(0, 0, sizes_[n - 1].width, sizes_[n - 1].height);
+	}
+
+	int base = level - 1;
+	while (base > 0 && (levels_[base].empty() ||
+		(need[base] & cv::Rect(origins_[base].x, origins_[base].y, levels_[base].cols, levels_[base].rows)) != need[base])){
+		base--;
+	}
+	cv::Mat src = levels_[base];
+	cv::Point origin = origins_[base];
+	if (base == 0 && (need[0] & region_) != need[0] && loader_){
+		// Pixels near the edges of level are approximated from the region if it fails
+		cv::Mat loaded = loader_->Load(need[0]);
+		if (!loaded.empty()){
+			src = loaded;
+			origin = need[0].tl();
+		}
+	}
+
+	for (int n = base + 1; n <= level; n++){
+		src = PyrDownRegion(src, origin, need[n], origin);
+		if (levels_[n].empty()){
+			levels_[n] = src;
+			origins_[n] = origin;
+		}
+	}
+}
+
+
+// Mip level for dst pixel (x, y): log2 of the largest source step per dst pixel
+int MipLevel(const cv::Matx33d& inv_h, double x, double y)
+{
+	double w = inv_h(2, 0) * x + inv_h(2, 1) * y + inv_h(2, 2);
+	if (w <= 0)
+		return 0;
+	double u = (inv_h(0, 0) * x + inv_h(0, 1) * y + inv_h(0, 2)) / w;
+	double v = (inv_h(1, 0) * x + inv_h(1, 1) * y + inv_h(1, 2)) / w;
+
+	// Jacobian of dst to src
+	double du_dx = (inv_h(0, 0) - u * inv_h(2, 0)) / w;
+	double dv_dx = (inv_h(1, 0) - v * inv_h(2, 0)) / w;
+	double du_dy = (inv_h(0, 1) - u * inv_h(2, 1)) / w;
+	double dv_dy = (inv_h(1, 1) - v * inv_h(2, 1)) / w;
+	double footprint = std::max(std::sqrt(du_dx * du_dx + dv_dx * dv_dx), std::sqrt(du_dy * du_dy + dv_dy * dv_dy));
+
+	return (footprint >= 2) ? cvFloor(std::log(footprint) / std::log(2.0)) : 0;
+}
+
+
+// Warp one row of tiles from the mip level chosen for each tile
+void WarpMipTileRow(MipPyramid& pyramid, const cv::Rect& src_rect, cv::Mat& dst, const cv::Matx33d& inv_h,
+	int interpolation, const cv::Scalar& border_value, int ty)
+{
+	for (int tx = 0; tx < dst.cols; tx += MIP_TILE_SIZE){
+		cv::Rect tile(tx, ty, std::min(MIP_TILE_SIZE, dst.cols - tx), std::min(MIP_TILE_SIZE, dst.rows - ty));
+		int level = std::min(MipLevel(inv_h, tile.x + tile.width * 0.5, tile.y + tile.height * 0.5), pyramid.MaxLevel());
+		cv::Point level_origin;
+		const cv::Mat& level_img = pyramid.Level(level, level_origin);
+
+		// src_rect on the level of whole image, and homography from dst to it
+		cv::Point origin = pyramid.Origin();
+		double scale = 1.0 / (1 << level);
+		int x1 = cvFloor((src_rect.x + origin.x) * scale), y1 = cvFloor((src_rect.y + origin.y) * scale);
+		int x2 = cvCeil((src_rect.x + src_rect.width + origin.x) * scale);
+		int y2 = cvCeil((src_rect.y + src_rect.height + origin.y) * scale);
+		cv::Rect crop = cv::Rect(x1, y1, x2 - x1, y2 - y1) & cv::Rect(level_origin.x, level_origin.y, level_img.cols, level_img.rows);
+		if (crop.width <= 0 || crop.height <= 0){
+			dst(tile).setTo(border_value);
+			continue;
+		}
+		cv::Matx33d level_mat(scale, 0, origin.x * scale - crop.x, 0, scale, origin.y * scale - crop.y, 0, 0, 1);
+
+		crop.x -= level_origin.x;
+		crop.y -= level_origin.y;
+		WarpRect(level_img(crop), dst, tile, level_mat * inv_h, interpolation, border_value);
+	}
+}
+
+
+// Warp rows of tiles in parallel
+class WarpMipBody : public cv::ParallelLoopBody
+{
+public:
+	WarpMipBody(MipPyramid& pyramid, const cv::Rect& src_rect, cv::Mat& dst, const cv::Matx33d& inv_h,
+		int interpolation, const cv::Scalar& border_value) :
+		pyramid_(pyramid), src_rect_(src_rect), dst_(dst), inv_h_(inv_h), interpolation_(interpolation), border_value_(border_value){}
+
+	void operator()(const cv::Range& range) const
+	{
+		for (int row = range.start; row < range.end; row++){
+			WarpMipTileRow(pyramid_, src_rect_, dst_, inv_h_, interpolation_, border_value_, row * MIP_TILE_SIZE);
+		}
+	}
+
+private:
+	MipPyramid& pyramid_;
+	cv::Rect src_rect_;
+	cv::Mat& dst_;
+	cv::Matx33d inv_h_;
+	int interpolation_;
+	cv::Scalar border_value_;
+};
+
+
+bool WarpPerspectiveMip(MipPyramid& pyramid, const cv::Rect& src_rect, cv::Mat& dst, const cv::Size& dst_size,
+	const cv::Mat& homography, int interpolation, const cv::Scalar& border_value)
+{
+	const cv::Mat& img = pyramid.Level(0);
+	if (!IsSupportedWarp(img.type(), interpolation))
+		return false;
+
+	dst.create(dst_size, img.type());
+	cv::Matx33d inv_h = InverseHomography(homography);
+	int num_rows = (dst_size.height + MIP_TILE_SIZE - 1) / MIP_TILE_SIZE;
+	if (dst_size.area() >= PARALLEL_WARP_AREA){
+		cv::parallel_for_(cv::Range(0, num_rows), WarpMipBody(pyramid, src_rect, dst, inv_h, interpolation, border_value));
+	}
+	else{
+		for (int row = 0; row < num_rows; row++){
+			WarpMipTileRow(pyramid, src_rect, dst, inv_h, interpolation, border_value, row * MIP_TILE_SIZE);
+		}
+	}
+	return true;
+}
+
+
+// Noise is added to color channels. Alpha channel is kept.
+template<typename T, int CN>
+void AddGaussianNoiseKernel(cv::Mat& img, double sigma, unsigned int seed)
+{
+	const int COLOR_CN = (CN < 4) ? CN : 3;
+
+	cv::RNG noise_rng(seed);
+	cv::Mat noise_row(1, img.cols * COLOR_CN, CV_32FC1);
+	const float* noise_ptr = noise_row.ptr<float>(0);
+	for (int y = 0; y < img.rows; y++){
+		noise_rng.fill(noise_row, cv::RNG::NORMAL, 0.0, sigma);
+		T* dst_ptr = img.ptr<T>(y);
+		const float* n = noise_ptr;
+		for (int x = 0; x < img.cols; x++, dst_ptr += CN, n += COLOR_CN){
+			for (int c = 0; c < COLOR_CN; c++){
+				dst_ptr[c] = cv::saturate_cast<T>(dst_ptr[c] + n[c]);
+			}
+		}
+	}
+}
+
+
+void AddGaussianNoise(cv::Mat& img, double sigma, unsigned int seed)
+{
+	CV_Assert(IsSupportedImageType(img.type()));
+
+	sigma *= DepthScale(img.depth());
+	switch (img.type()){
+	case CV_8UC1:
+		AddGaussianNoiseKernel<unsigned char, 1>(img, sigma, seed);
+		break;
+	case CV_8UC3:
+		AddGaussianNoiseKernel<unsigned char, 3>(img, sigma, seed);
+		break;
+	case CV_8UC4:
+		AddGaussianNoiseKernel<unsigned char, 4>(img, sigma, seed);
+		break;
+	default:
+		AddGaussianNoiseKernel<unsigned short, 1>(img, sigma, seed);
+		break;
+	}
+}
+
+
+// cv::flip() flips in place by its vectorized kernels. Both directions (flip_code -1) run its vertical and horizontal passes.
+// A single pass which swaps each pixel with the opposite one is not used, since it was several times slower for 3 channels.
+void FlipInPlace(cv::Mat& img, bool hflip, bool vflip)
+{
+	if (hflip || vflip){
+		int flip_code = (hflip && vflip) ? -1 : hflip ? 1 : 0;
+		cv::flip(img, img, flip_code);
+	}
+}
+
+
+// Lookup table of brightness, contrast, and gamma for all values of T
+template<typename T>
+void ToneCurveLUT(double brightness, double contrast, double gamma, std::vector<T>& lut)
+{
+	const double max_val = std::numeric_limits<T>::max();
+	const double scale = max_val / 255.0;
+	lut.resize((size_t)max_val + 1);
+	for (size_t i = 0; i < lut.size(); i++){
+		double val = contrast * (i - 128 * scale) + 128 * scale + brightness * scale;
+		val = std::min(std::max(val, 0.0), max_val);
+		lut[i] = cv::saturate_cast<T>(max_val * std::pow(val / max_val, gamma));
+	}
+}
+
+
+// Tone curve is applied to color channels. Alpha channel is kept.
+template<typename T, int CN>
+void ToneCurveKernel(const cv::Mat& src, cv::Mat& dst, const std::vector<T>& lut)
+{
+	const int COLOR_CN = (CN < 4) ? CN : 3;
+
+	dst.create(src.size(), src.type());
+	for (int y = 0; y < src.rows; y++){
+		const T* src_ptr = src.ptr<T>(y);
+		T* dst_ptr = dst.ptr<T>(y);
+		for (int x = 0; x < src.cols; x++, src_ptr += CN, dst_ptr += CN){
+			for (int c = 0; c < COLOR_CN; c++){
+				dst_ptr[c] = lut[src_ptr[c]];
+			}
+			for (int c = COLOR_CN; c < CN; c++){
+				dst_ptr[c] = src_ptr[c];
+			}
+		}
+	}
+}
+
+
+void ApplyToneCurve(const cv::Mat& src, cv::Mat& dst, double brightness, double contrast, double gamma)
+{
+	CV_Assert(IsSupportedImageType(src.type()));
+
+	if (src.depth() == CV_16U){
+		std::vector<unsigned short> lut;
+		ToneCurveLUT(brightness, contrast, gamma, lut);
+		ToneCurveKernel<unsigned short, 1>(src, dst, lut);
+		return;
+	}
+
+	std::vector<unsigned char> lut;
+	ToneCurveLUT(brightness, contrast, gamma, lut);
+	if (src.channels() == 4){
+		ToneCurveKernel<unsigned char, 4>(src, dst, lut);
+	}
+	else{
+		// cv::LUT is already optimized for 8 bit images
+		cv::LUT(src, cv::Mat(lut), dst);
+	}
+}
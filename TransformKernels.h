@@ -0,0 +1,199 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+#ifndef __TRANSFORM_KERNELS__
+#define __TRANSFORM_KERNELS__
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**********************************************
+Per-pixel kernels of image transformation.
+Each kernel is a template on pixel type and channel count,
+and the type of image is dispatched once per image so that inner loops have fixed trip counts.
+Warp computes maps of blocks of output in float and samples them by cv::remap().
+Supported types are CV_8UC1, CV_8UC3, CV_8UC4 and CV_16UC1.
+Alpha channel of CV_8UC4 is not changed by noise and tone curve.
+Pixel values of parameters are given in 8 bit scale and scaled to the depth of image.
+***********************************************/
+
+//! Whether the kernels support the type of image
+bool IsSupportedImageType(int type);
+
+//! Row of map of src coordinates from 3x3 homography h from dst coordinates to src coordinates, computed in double
+/*!
+\param[in] h 3x3 homography from dst coordinates to src coordinates
+\param[in] dy y coordinate of the row in dst
+\param[in] width width of the row
+\param[out] map_x_ptr x coordinates of src
+\param[out] map_y_ptr y coordinates of src
+Pixels behind the camera (w <= 0) are mapped to (-1, -1), out of src.
+*/
+void DoubleMapRow(const cv::Matx33d& h, int dy, int width, float* map_x_ptr, float* map_y_ptr);
+
+//! Row of map computed in float blocks of 64 pixels (see DoubleMapRow())
+/*!
+\param[in] guardrail compare the ends of each block with double
+\return false if guardrail is set and error of a block exceeds 1/32 pixel (the row is to be computed by DoubleMapRow())
+*/
+bool FloatMapRow(const cv::Matx33d& h, int dy, int width, float* map_x_ptr, float* map_y_ptr, bool guardrail);
+
+//! Warp image by homography (maps are generated per band of output and sampled by cv::remap())
+/*!
+\param[in] src input image
+\param[out] dst output image
+\param[in] dst_size size of output image
+\param[in] homography 3x3 homography from src coordinates to dst coordinates (CV_64FC1)
+\param[in] interpolation cv::INTER_NEAREST or cv::INTER_LINEAR
+\param[in] border_value pixel value outside of src
+\return false if type of src or interpolation is not supported (dst is not changed)
+
+Large output is split into bands of rows which are warped in parallel by cv::parallel_for_().
+*/
+bool WarpPerspectiveFused(const cv::Mat& src, cv::Mat& dst, const cv::Size& dst_size, const cv::Mat& homography,
+	int interpolation = cv::INTER_LINEAR, const cv::Scalar& border_value = cv::Scalar(0, 0, 0, 0));
+
+//! Loader of regions of image which is not loaded at once (see MipPyramid)
+class MipRegionLoader
+{
+public:
+	virtual ~MipRegionLoader(){}
+
+	//! Load rect of image (rect is inside of image). Return empty image if it fails.
+	virtual cv::Mat Load(const cv::Rect& rect) = 0;
+};
+
+//! Mip pyramid of source image
+/*!
+Levels are built by cv::pyrDown() at the first request, so that one source image shares them among its samples.
+Level() can be called from several threads.
+Level n has 1/2^n size of the source, and pixel (x, y) of level n is at (x * 2^n, y * 2^n) of the source.
+
+Pyramid of a region of image (tile) has the pixels of the levels of whole image around the region.
+Each level is built from a region of image which is larger than the tile by the reach of cv::pyrDown() (about 2^(n+1) pixels),
+which is loaded by the loader.
+*/
+class MipPyramid
+{
+public:
+	explicit MipPyramid(const cv::Mat& img);
+
+	//! Pyramid of region of image
+	/*!
+	\param[in] region region of image (level 0)
+	\param[in] origin position of region on image
+	\param[in] image_size size of whole image
+	\param[in] loader loader of larger regions of image for levels (levels are built from region if NULL)
+	*/
+	MipPyramid(const cv::Mat& region, const cv::Point& origin, const cv::Size& image_size, MipRegionLoader* loader);
+
+	//! Image of level. Level is limited to MaxLevel().
+	const cv::Mat& Level(int level);
+
+	//! Image of level and its position on the level of whole image
+	const cv::Mat& Level(int level, cv::Point& origin);
+
+	//! Smallest level whose width and height are not less than 1
+	int MaxLevel() const { return max_level_; }
+
+	//! Position of level 0 on image
+	cv::Point Origin() const { return region_.tl(); }
+
+	//! rect of level 0 shrunk to size by area averaging (prefilter of rotation)
+	/*!
+	The last few results are kept, so that samples which shrink the same rect to the same size share one resize.
+	It can be called from several threads.
+	*/
+	cv::Mat Shrunk(const cv::Rect& rect, const cv::Size& size);
+
+private:
+	void Build(int level);
+
+	struct ShrunkImage
+	{
+		cv::Rect rect;
+		cv::Size size;
+		cv::Mat img;
+	};
+
+	std::deque<cv::Mat> levels_;		// references to levels are kept while new levels are added (empty until built)
+	std::vector<cv::Point> origins_;	// position of each level on the level of whole image
+	std::vector<cv::Size> sizes_;		// size of each level of whole image
+	cv::Rect region_;					// region of level 0
+	MipRegionLoader* loader_;
+	int max_level_;
+	std::mutex mutex_;
+	cv::Mat region_img_;				// level 0, which is read without lock
+	std::deque<ShrunkImage> shrunk_;	// results of Shrunk() from the oldest
+	std::mutex shrunk_mutex_;
+};
+
+//! Warp src_rect of image by homography, sampling the mip level chosen for each tile of dst
+/*!
+The level of each tile is chosen from the Jacobian of the homography at the center of the tile,
+so that source is not sampled at heavy minification. Rows of tiles of large output are warped in parallel.
+\param[in,out] pyramid mip pyramid of input image (levels are built if needed)
+\param[in] src_rect area of input image to be sampled. Outside of it is border.
+\param[out] dst output image
+\param[in] dst_size size of output image
+\param[in] homography 3x3 homography from input image coordinates to dst coordinates (CV_64FC1)
+\return false if type of image or interpolation is not supported (dst is not changed)
+*/
+bool WarpPerspectiveMip(MipPyramid& pyramid, const cv::Rect& src_rect, cv::Mat& dst, const cv::Size& dst_size,
+	const cv::Mat& homography, int interpolation = cv::INTER_LINEAR, const cv::Scalar& border_value = cv::Scalar(0, 0, 0, 0));
+
+//! Add Gaussian noise in place
+/*!
+\param[in,out] img image
+\param[in] sigma sigma of noise (8 bit scale)
+\param[in] seed seed of noise
+*/
+void AddGaussianNoise(cv::Mat& img, double sigma, unsigned int seed);
+
+//! Flip image in place
+void FlipInPlace(cv::Mat& img, bool hflip, bool vflip);
+
+//! Apply brightness, contrast, and gamma by lookup table
+/*!
+\param[in] src input image
+\param[out] dst output image (can be the same as src)
+\param[in] brightness shift of pixel value (8 bit scale)
+\param[in] contrast scale of pixel value around the middle
+\param[in] gamma gamma of tone curve
+*/
+void ApplyToneCurve(const cv::Mat& src, cv::Mat& dst, double brightness, double contrast, double gamma);
+
+
+#endif
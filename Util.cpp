@@ -33,6 +33,8 @@
 
 #include "Util.h"
 #include <fstream>
+#include <set>
+#include <cctype>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 
@@ -138,9 +140,10 @@ namespace util{
 	\param[in] anno_file Ame[Vt@C
 	\param[in] img_file 摜t@Cւ̃pX
 	\param[int] obj_rects e摜ɂꂽAme[ṼXg
+	\param[in] tag sɕt镶ȉꍇ͕tȂj
 	\return ۑ̐
 	*/
-	bool AddAnnotationLine(const std::string& anno_file, const std::string& img_file, const std::vector<cv::Rect>& obj_rects, const std::string& sep)
+	bool AddAnnotationLine(const std::string& anno_file, const std::string& img_file, const std::vector<cv::Rect>& obj_rects, const std::string& sep, const std::string& tag)
 	{
 		// o̓t@CJ
 		std::ofstream ofs(anno_file, std::ios::app);
@@ -153,11 +156,56 @@ namespace util{
 			cv::Rect rect = obj_rects[i];
 			ofs << sep << rect.x << sep << rect.y << sep << rect.width << sep << rect.height;
 		}
+		if (!tag.empty()){
+			ofs << sep << tag;
+		}
 		ofs << std::endl;
 		return true;
 	}
 
 
+	unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash)
+	{
+		const unsigned char* ptr = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++){
+			hash ^= ptr[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+
+	Hash128 HashBytes128(const void* data, size_t size, Hash128 hash)
+	{
+		// FNVf 2^88 + 0x13B Ƃ̐ςʂƉʂ64bitŌvZ
+		const unsigned long long prime_low = 0x13B;
+		const unsigned char* ptr = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++){
+			hash.low ^= ptr[i];
+			unsigned long long carry = ((hash.low >> 32) * prime_low + (((hash.low & 0xFFFFFFFFULL) * prime_low) >> 32)) >> 32;
+			hash.high = hash.high * prime_low + carry + (hash.low << 24);
+			hash.low *= prime_low;
+		}
+		return hash;
+	}
+
+
+	bool HashFile(const std::string& file, unsigned long long& hash)
+	{
+		std::ifstream ifs(file, std::ios::binary);
+		if (!ifs.is_open()){
+			return false;
+		}
+
+		hash = HashBytes(NULL, 0);
+		std::vector<char> buf(1 << 16);
+		while (ifs.read(&buf[0], buf.size()) || ifs.gcount() > 0){
+			hash = HashBytes(&buf[0], ifs.gcount(), hash);
+		}
+		return !ifs.bad();
+	}
+
+
 	// fBNg摜t@Cꗗ擾
 	bool ReadImageFilesInDirectory(const std::string& img_dir, std::vector<std::string>& image_lists)
 	{
@@ -178,14 +226,27 @@ namespace util{
 		return true;
 	}
 
+	// 摜t@C̊gqij
+	const char* IMAGE_EXTENSIONS[] = { ".jpg", ".jpeg", ".bmp", ".png", ".dib", ".pbm", ".pgm", ".ppm", ".sr", ".ras" };
+
+
 	bool hasImageExtention(const std::string& filename){
-		std::string ext = boost::filesystem::path(filename).extension().string();
+		static const std::set<std::string> extensions(IMAGE_EXTENSIONS,
+			IMAGE_EXTENSIONS + sizeof(IMAGE_EXTENSIONS) / sizeof(IMAGE_EXTENSIONS[0]));
 
-		return (ext == ".jpg" || ext == ".JPG" || ext == ".jpeg" || ext == ".JPEG" ||
-			ext == ".bmp" || ext == ".BMP" || ext == ".png" || ext == ".PNG" ||
-			ext == ".dib" || ext == ".DIB" || ext == ".pbm" || ext == ".PBM" ||
-			ext == ".pgm" || ext == ".PGM" || ext == ".ppm" || ext == ".PPM" ||
-			ext == ".sr" || ext == ".SR" || ext == ".ras" || ext == ".RAS");
+		// Ō'.'ȍ~ɂČifBNg'.'͑ΏۊOj
+		std::string::size_type dot = filename.find_last_of('.');
+		if (dot == std::string::npos || filename.find_first_of("/\\", dot) != std::string::npos){
+			return false;
+		}
+		std::string ext = filename.substr(dot);
+		if (ext.size() > 5){
+			return false;
+		}
+		for (int i = 0; i < ext.size(); i++){
+			ext[i] = std::tolower((unsigned char)ext[i]);
+		}
+		return extensions.count(ext) > 0;
 	}
 
 
@@ -61,13 +61,42 @@ namespace util{
 	\param[in] anno_file Ame[Vt@C
 	\param[in] img_file 摜t@Cւ̃pX
 	\param[int] obj_rects e摜ɂꂽAme[ṼXg
+	\param[in] tag sɕt镶ȉꍇ͕tȂj
 	\return ۑ̐
 	*/
-	bool AddAnnotationLine(const std::string& anno_file, const std::string& img_file, const std::vector<cv::Rect>& obj_rects, const std::string& sep);
+	bool AddAnnotationLine(const std::string& anno_file, const std::string& img_file, const std::vector<cv::Rect>& obj_rects, const std::string& sep, const std::string& tag = "");
+
+	//! oCg̃nbVliFNV-1a 64bitj
+	/*!
+	\param[in] hash Õf[^̃nbVliănbVꍇj
+	*/
+	unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash = 14695981039346656037ULL);
+
+	//! 128bit̃nbVlilFNV-1a 128bit̃ItZbgj
+	struct Hash128
+	{
+		Hash128() : high(0x6c62272e07bb0142ULL), low(0x62b821756295c58dULL){}
+		unsigned long long high, low;
+	};
+
+	//! oCg̃nbVliFNV-1a 128bitj
+	/*!
+	\param[in] hash Õf[^̃nbVliănbVꍇj
+	*/
+	Hash128 HashBytes128(const void* data, size_t size, Hash128 hash = Hash128());
+
+	//! t@CẽnbVliFNV-1a 64bitj
+	/*!
+	\param[in] file t@C
+	\param[out] hash nbVl
+	\return ǂݍ݂̐
+	*/
+	bool HashFile(const std::string& file, unsigned long long& hash);
 
 	// fBNg摜t@Cꗗ擾
 	bool ReadImageFilesInDirectory(const std::string& img_dir, std::vector<std::string>& image_lists);
 
+	// 摜t@C̊gqi啶ʂȂj
 	bool hasImageExtention(const std::string& filename);
 
 	bool ReadCSVFile(const std::string& input_file, std::vector<std::vector<std::string>>& output_strings,
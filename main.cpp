@@ -46,6 +46,9 @@ DataAugmentation <annotation name> <output folder> -a <output annnotation> -c <c
 #include <iostream>
 #include "Util.h"
 #include "DataAugmentation.h"
+#include "RandomRotation.h"
+#include "FileScanner.h"
+#include "PlanLog.h"
 
 using namespace boost::program_options;
 
@@ -98,11 +101,35 @@ bool ParseCommandLine(int argc, char * argv[], std::string& conf_file,
 }
 
 
-bool LoadConf(const std::string& conf_file, int& num_generate, 
-	double& yaw_sigma, double& pitch_sigma, double& roll_sigma,
-	double& blur_max_sigma, double& noise_max_sigma,
-	double& x_slide_sigma, double& y_slide_sigma, double& aspect_sigma,
-	double& hflip_ratio, double& vflip_ratio)
+// Parse "<min> <max> <step>" of sweep into list of angles
+std::vector<double> ParseSweep(const std::string& name, const std::string& sweep_str)
+{
+	std::vector<std::string> sep;
+	sep.push_back(" ");
+	std::vector<std::string> tokens = util::TokenizeString(sweep_str, sep);
+	std::vector<double> values;
+	for (int i = 0; i < tokens.size(); i++){
+		if (!tokens[i].empty())
+			values.push_back(atof(tokens[i].c_str()));
+	}
+
+	std::vector<double> angles;
+	if (values.empty())
+		return angles;
+
+	if (values.size() != 3 || values[0] > values[1] || values[2] <= 0){
+		std::string err_msg = "\"" + name + "\" must be \"<min> <max> <step>\" with positive step.";
+		throw std::exception(err_msg.c_str());
+	}
+	int num = (int)std::floor((values[1] - values[0]) / values[2] + 1e-6) + 1;
+	for (int i = 0; i < num; i++){
+		angles.push_back(values[0] + i * values[2]);
+	}
+	return angles;
+}
+
+
+bool LoadConf(const std::string& conf_file, AugmentationParams& params)
 {
 	// set argments of command options
 	options_description opt("option");
@@ -117,7 +144,28 @@ bool LoadConf(const std::string& conf_file, int& num_generate,
 		("y_slide_sigma", value<double>()->default_value(0), "sigma of slide in y direction (ratio of height)")
 		("aspect_ratio_sigma", value<double>()->default_value(0), "sigma of aspect ratio deformation")
 		("horizontal_flip", value<double>()->default_value(0), "probability to flip image from left to right (from 0 to 1)")
-		("vertical_flip", value<double>()->default_value(0), "probability to flip image from up to down (from 0 to 1)");
+		("vertical_flip", value<double>()->default_value(0), "probability to flip image from up to down (from 0 to 1)")
+		("brightness_sigma", value<double>()->default_value(0), "sigma of brightness shift (pixel value)")
+		("contrast_sigma", value<double>()->default_value(0), "sigma of contrast change (ratio)")
+		("gamma_sigma", value<double>()->default_value(0), "sigma of gamma in log scale")
+		("hue_sigma", value<double>()->default_value(0), "sigma of hue rotation (degree)")
+		("saturation_sigma", value<double>()->default_value(0), "sigma of saturation change (ratio)")
+		("whole_image", value<bool>()->default_value(false), "transform whole image and all annotated rectangles together")
+		("min_visible_ratio", value<double>()->default_value(0.5), "minimum visible area ratio of transformed rectangle to keep it (from 0 to 1)")
+		("yaw_sweep", value<std::string>()->default_value(""), "\"<min> <max> <step>\" of yaw angles (degree) for sweep mode")
+		("pitch_sweep", value<std::string>()->default_value(""), "\"<min> <max> <step>\" of pitch angles (degree) for sweep mode")
+		("roll_sweep", value<std::string>()->default_value(""), "\"<min> <max> <step>\" of roll angles (degree) for sweep mode")
+		("load_unchanged", value<bool>()->default_value(false), "load images with alpha channel and 16 bit depth as they are")
+		("output_width", value<int>()->default_value(0), "width of output image (0: width of area)")
+		("output_height", value<int>()->default_value(0), "height of output image (0: height of area)")
+		("seed", value<unsigned int>()->default_value(0), "seed of random numbers")
+		("cache_folder", value<std::string>()->default_value(""), "folder of output cache shared among runs (empty: no cache)")
+		("verbose", value<bool>()->default_value(false), "log every file instead of progress line")
+		("stats_file", value<std::string>()->default_value(""), "JSON file of progress statistics rewritten every second (empty: not written)")
+		("num_threads", value<int>()->default_value(0), "number of threads (0: number of hardware threads)")
+		("memory_budget", value<int>()->default_value(0), "budget of memory of images in flight (MB, 0: unlimited)")
+		("plan_log", value<std::string>()->default_value(""), "binary log of parameters of every rendered image (empty: not written)")
+		("replay_ids", value<std::string>()->default_value(""), "names of output images rendered again when input is plan log (empty: all)");
 
 	variables_map argmap;
 	try{
@@ -131,29 +179,67 @@ bool LoadConf(const std::string& conf_file, int& num_generate,
 		store(parse_config_file(ifs, opt), argmap);
 		notify(argmap);
 
-		num_generate = argmap["generate_num"].as<int>();
-		yaw_sigma = argmap["yaw_sigma"].as<double>();
-		pitch_sigma = argmap["pitch_sigma"].as<double>();
-		roll_sigma = argmap["roll_sigma"].as<double>();
-		blur_max_sigma = argmap["blur_max_sigma"].as<double>(); 
-		noise_max_sigma = argmap["noise_max_sigma"].as<double>();
-		x_slide_sigma = argmap["x_slide_sigma"].as<double>(); 
-		y_slide_sigma = argmap["y_slide_sigma"].as<double>();
-		aspect_sigma = argmap["aspect_ratio_sigma"].as<double>();
-		hflip_ratio = argmap["horizontal_flip"].as<double>();
-		vflip_ratio = argmap["vertical_flip"].as<double>();
-
-		if (num_generate < 0 || yaw_sigma < 0 || pitch_sigma < 0 || roll_sigma < 0 ||
-			blur_max_sigma < 0 || noise_max_sigma < 0 ||
-			x_slide_sigma < 0 || y_slide_sigma < 0 || aspect_sigma < 0){
+		params.num_generate = argmap["generate_num"].as<int>();
+		params.yaw_sigma = argmap["yaw_sigma"].as<double>();
+		params.pitch_sigma = argmap["pitch_sigma"].as<double>();
+		params.roll_sigma = argmap["roll_sigma"].as<double>();
+		params.blur_max_sigma = argmap["blur_max_sigma"].as<double>(); 
+		params.noise_max_sigma = argmap["noise_max_sigma"].as<double>();
+		params.x_slide_sigma = argmap["x_slide_sigma"].as<double>(); 
+		params.y_slide_sigma = argmap["y_slide_sigma"].as<double>();
+		params.aspect_sigma = argmap["aspect_ratio_sigma"].as<double>();
+		params.hflip_ratio = argmap["horizontal_flip"].as<double>();
+		params.vflip_ratio = argmap["vertical_flip"].as<double>();
+		params.brightness_sigma = argmap["brightness_sigma"].as<double>();
+		params.contrast_sigma = argmap["contrast_sigma"].as<double>();
+		params.gamma_sigma = argmap["gamma_sigma"].as<double>();
+		params.hue_sigma = argmap["hue_sigma"].as<double>();
+		params.saturation_sigma = argmap["saturation_sigma"].as<double>();
+		params.whole_image = argmap["whole_image"].as<bool>();
+		params.min_visible_ratio = argmap["min_visible_ratio"].as<double>();
+		params.yaw_sweep = ParseSweep("yaw_sweep", argmap["yaw_sweep"].as<std::string>());
+		params.pitch_sweep = ParseSweep("pitch_sweep", argmap["pitch_sweep"].as<std::string>());
+		params.roll_sweep = ParseSweep("roll_sweep", argmap["roll_sweep"].as<std::string>());
+		params.load_unchanged = argmap["load_unchanged"].as<bool>();
+		params.output_size.width = argmap["output_width"].as<int>();
+		params.output_size.height = argmap["output_height"].as<int>();
+		params.seed = argmap["seed"].as<unsigned int>();
+		params.cache_folder = argmap["cache_folder"].as<std::string>();
+		params.verbose = argmap["verbose"].as<bool>();
+		params.stats_file = argmap["stats_file"].as<std::string>();
+		params.num_threads = argmap["num_threads"].as<int>();
+		params.memory_budget_mb = argmap["memory_budget"].as<int>();
+		params.plan_log = argmap["plan_log"].as<std::string>();
+
+		std::vector<std::string> sep;
+		sep.push_back(" ");
+		std::vector<std::string> ids = util::TokenizeString(argmap["replay_ids"].as<std::string>(), sep);
+		for (int i = 0; i < ids.size(); i++){
+			if (!ids[i].empty())
+				params.replay_ids.push_back(ids[i]);
+		}
+
+		if (params.num_generate < 0 || params.yaw_sigma < 0 || params.pitch_sigma < 0 || params.roll_sigma < 0 ||
+			params.blur_max_sigma < 0 || params.noise_max_sigma < 0 ||
+			params.x_slide_sigma < 0 || params.y_slide_sigma < 0 || params.aspect_sigma < 0 ||
+			params.brightness_sigma < 0 || params.contrast_sigma < 0 || params.gamma_sigma < 0 ||
+			params.hue_sigma < 0 || params.saturation_sigma < 0 ||
+			params.output_size.width < 0 || params.output_size.height < 0 || params.num_threads < 0 ||
+			params.memory_budget_mb < 0){
 			throw std::exception("All value must NOT be negative.");
 		}
-		if (hflip_ratio < 0 || hflip_ratio > 1) {
+		if (params.hflip_ratio < 0 || params.hflip_ratio > 1) {
 			throw std::exception("\"horizontal_flip\" must be between 0 and 1");
 		}
-		if (vflip_ratio < 0 || vflip_ratio > 1) {
+		if (params.vflip_ratio < 0 || params.vflip_ratio > 1) {
 			throw std::exception("\"vertical_flip\" must be between 0 and 1");
 		}
+		if (params.min_visible_ratio < 0 || params.min_visible_ratio > 1) {
+			throw std::exception("\"min_visible_ratio\" must be between 0 and 1");
+		}
+		if ((params.output_size.width > 0) != (params.output_size.height > 0)) {
+			throw std::exception("\"output_width\" and \"output_height\" must be set together");
+		}
 
 		return true;
 	}
@@ -169,13 +255,7 @@ bool LoadConf(const std::string& conf_file, int& num_generate,
 
 void GetImageFileNames(const std::string& input_name, std::vector<std::string>& img_files, std::vector<std::vector<cv::Rect>>& positions)
 {
-	using namespace boost::filesystem;
-
-	// if input_name is directory
-	if (is_directory(path(input_name))){
-		util::ReadImageFilesInDirectory(input_name, img_files);
-	}
-	else if (util::hasImageExtention(input_name)){
+	if (util::hasImageExtention(input_name)){
 		img_files.push_back(input_name);
 	}
 	else{
@@ -190,19 +270,31 @@ int main(int argc, char * argv[])
 	if (!ParseCommandLine(argc, argv, conf_file, input_name, output_folder, output_anno_file))
 		return -1;
 
-	int num_generate;
-	double yaw_range, pitch_range, roll_range, x_slide, y_slide, 
-		blur_sigma, noise_sigma, aspect_range, hflip_ratio, vflip_ratio;
-	if (!LoadConf(conf_file, num_generate, yaw_range, pitch_range, roll_range,
-		blur_sigma, noise_sigma, x_slide, y_slide, aspect_range, hflip_ratio, vflip_ratio))
+	AugmentationParams params;
+	if (!LoadConf(conf_file, params))
 		return -1;
 
+	// Plan log renders logged images again
+	if (IsPlanLog(input_name)){
+		if (!ReplayTransformPlans(input_name, output_folder, output_anno_file, params)){
+			std::cout << "Fail to read plan log " << input_name << std::endl;
+			return -1;
+		}
+		return 0;
+	}
+
+	// Directory is scanned recursively while found images are transformed
+	if (boost::filesystem::is_directory(boost::filesystem::path(input_name))){
+		ImageFileScanner scanner(input_name, params.num_threads);
+		DataAugmentation(scanner, output_folder, output_anno_file, params);
+		return 0;
+	}
+
 	std::vector<std::string> img_files;
 	std::vector<std::vector<cv::Rect>> obj_positions;
 	GetImageFileNames(input_name, img_files, obj_positions);
 
-	DataAugmentation(img_files, obj_positions, output_folder, output_anno_file, num_generate, yaw_range, pitch_range, roll_range,
-		blur_sigma, noise_sigma, x_slide, y_slide, aspect_range, hflip_ratio, vflip_ratio);
+	DataAugmentation(img_files, obj_positions, output_folder, output_anno_file, params);
 
 	return 0;
 }
@@ -0,0 +1,269 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+/**********************************************
+DataAugmentationPy:
+Python binding of ImageTransform() for on-the-fly augmentation.
+Images (HxW, HxWx3 or HxWx4 of uint8, or HxW of uint16) are exchanged as NumPy arrays without copy,
+and GIL is released while transforming. seed is params.seed if it is not given.
+
+import DataAugmentationPy as da
+params = da.AugmentationParams()
+params.yaw_sigma = 10
+img = da.load(file, params)		# alpha channel and 16 bit depth are kept if params.load_unchanged
+dst = da.transform(img, (x, y, w, h), params, seed)
+dst, rects = da.transform_with_rects(img, [(x, y, w, h), ...], params, seed)
+params.yaw_sweep = [-30, -15, 0, 15, 30]
+for dst, (yaw, pitch, roll) in da.transform_sweep(img, (x, y, w, h), params, seed): ...
+***********************************************/
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <stdexcept>
+#include "../DataAugmentation.h"
+#include "../TransformKernels.h"
+
+namespace py = pybind11;
+
+
+// Refer NumPy array (HxW, HxWx3 or HxWx4 of uint8, or HxW of uint16) as cv::Mat without copy
+cv::Mat ArrayToMat(const py::array& arr)
+{
+	int depth;
+	if (py::isinstance<py::array_t<unsigned char>>(arr)){
+		depth = CV_8U;
+	}
+	else if (py::isinstance<py::array_t<unsigned short>>(arr)){
+		depth = CV_16U;
+	}
+	else{
+		throw std::invalid_argument("image must be array of uint8 or uint16");
+	}
+
+	int channels = (arr.ndim() == 3) ? (int)arr.shape(2) : 1;
+	if ((arr.ndim() != 2 && arr.ndim() != 3) || !IsSupportedImageType(CV_MAKETYPE(depth, channels))){
+		throw std::invalid_argument("image must be HxW, HxWx3 or HxWx4 array of uint8, or HxW array of uint16");
+	}
+
+	// Pixels of a row must be contiguous, and rows must be in order
+	py::ssize_t elem_size = arr.itemsize();
+	if (arr.strides(1) != elem_size * channels || (arr.ndim() == 3 && arr.strides(2) != elem_size) ||
+		arr.strides(0) < arr.shape(1) * arr.strides(1)){
+		throw std::invalid_argument("pixels of image rows must be contiguous");
+	}
+
+	return cv::Mat((int)arr.shape(0), (int)arr.shape(1), CV_MAKETYPE(depth, channels), (void*)arr.data(), (size_t)arr.strides(0));
+}
+
+
+// NumPy array which shares the buffer of cv::Mat. The Mat is released together with the array.
+py::array MatToArray(const cv::Mat& mat)
+{
+	cv::Mat* holder = new cv::Mat(mat);
+	py::capsule owner(holder, [](void* ptr){ delete reinterpret_cast<cv::Mat*>(ptr); });
+
+	std::vector<py::ssize_t> shape, strides;
+	shape.push_back(holder->rows);
+	shape.push_back(holder->cols);
+	strides.push_back(holder->step[0]);
+	strides.push_back(holder->elemSize());
+	if (holder->channels() > 1){
+		shape.push_back(holder->channels());
+		strides.push_back(holder->elemSize1());
+	}
+	py::dtype dtype = (holder->depth() == CV_16U) ? py::dtype::of<unsigned short>() : py::dtype::of<unsigned char>();
+	return py::array(dtype, shape, strides, holder->data, owner);
+}
+
+
+// Seed given to function, or params.seed
+unsigned long long SampleSeed(const py::object& seed, const AugmentationParams& params)
+{
+	return seed.is_none() ? params.seed : seed.cast<unsigned long long>();
+}
+
+
+// Load image as DataAugmentation() does
+py::array Load(const std::string& file, const AugmentationParams& params)
+{
+	cv::Mat img;
+	{
+		py::gil_scoped_release release;
+		img = cv::imread(file, params.load_unchanged ? cv::IMREAD_UNCHANGED : cv::IMREAD_COLOR);
+	}
+	if (img.empty())
+		throw std::runtime_error("Fail to load " + file);
+	if (!IsSupportedImageType(img.type()))
+		throw std::runtime_error("Unsupported image type: " + file);
+	return MatToArray(img);
+}
+
+
+// (x, y, width, height) to cv::Rect. Empty means whole image.
+cv::Rect ToRect(const std::vector<int>& rect)
+{
+	if (rect.empty())
+		return cv::Rect();
+	if (rect.size() != 4)
+		throw std::invalid_argument("rectangle must be (x, y, width, height)");
+	return cv::Rect(rect[0], rect[1], rect[2], rect[3]);
+}
+
+
+py::array Transform(const py::array& img, const std::vector<int>& area, const AugmentationParams& params, const py::object& seed)
+{
+	cv::Mat src = ArrayToMat(img);
+	cv::Rect rect = ToRect(area);
+	unsigned long long rng_seed = SampleSeed(seed, params);
+
+	cv::Mat dst;
+	{
+		py::gil_scoped_release release;
+		cv::RNG rng(rng_seed);
+		dst = ImageTransform(src, rect, params, rng);
+	}
+	return MatToArray(dst);
+}
+
+
+py::tuple TransformWithRects(const py::array& img, const std::vector<std::vector<int>>& rects,
+	const AugmentationParams& params, const py::object& seed)
+{
+	cv::Mat src = ArrayToMat(img);
+	std::vector<cv::Rect> obj_rects;
+	for (int i = 0; i < rects.size(); i++){
+		obj_rects.push_back(ToRect(rects[i]));
+	}
+	unsigned long long rng_seed = SampleSeed(seed, params);
+
+	cv::Mat dst;
+	std::vector<cv::Rect> dst_rects;
+	{
+		py::gil_scoped_release release;
+		cv::RNG rng(rng_seed);
+		dst = ImageTransformWithRects(src, obj_rects, dst_rects, params, rng);
+	}
+
+	py::list rect_list;
+	for (int i = 0; i < dst_rects.size(); i++){
+		rect_list.append(py::make_tuple(dst_rects[i].x, dst_rects[i].y, dst_rects[i].width, dst_rects[i].height));
+	}
+	return py::make_tuple(MatToArray(dst), rect_list);
+}
+
+
+// Render area at every pose of sweep mode. Slide, aspect ratio change, and random rotation are not applied as in DataAugmentation().
+py::list TransformSweep(const py::array& img, const std::vector<int>& area, const AugmentationParams& params, const py::object& seed)
+{
+	cv::Mat src = ArrayToMat(img);
+	cv::Rect rect = ToRect(area);
+	unsigned long long rng_seed = SampleSeed(seed, params);
+	std::vector<cv::Vec3d> poses = SweepPoses(params);
+	if (poses.empty())
+		throw std::invalid_argument("yaw_sweep, pitch_sweep, or roll_sweep must be given");
+
+	AugmentationParams sweep_params = params;
+	sweep_params.yaw_sigma = sweep_params.pitch_sigma = sweep_params.roll_sigma = 0;
+	sweep_params.x_slide_sigma = sweep_params.y_slide_sigma = sweep_params.aspect_sigma = 0;
+
+	std::vector<cv::Mat> dsts(poses.size());
+	{
+		py::gil_scoped_release release;
+		cv::RNG rng(rng_seed);
+		for (int k = 0; k < poses.size(); k++){
+			TransformPlan plan = PlanImageTransform(src.size(), rect, sweep_params, rng);
+			plan.yaw = poses[k][0], plan.pitch = poses[k][1], plan.roll = poses[k][2];
+			plan.rotate = (plan.yaw != 0 || plan.pitch != 0 || plan.roll != 0);
+			cv::Mat homography;
+			ExecuteTransformPlan(src, plan, dsts[k], homography);
+		}
+	}
+
+	py::list results;
+	for (int k = 0; k < poses.size(); k++){
+		results.append(py::make_tuple(MatToArray(dsts[k]), py::make_tuple(poses[k][0], poses[k][1], poses[k][2])));
+	}
+	return results;
+}
+
+
+PYBIND11_MODULE(DataAugmentationPy, m)
+{
+	m.doc() = "Random image transformation for data augmentation";
+
+	py::class_<AugmentationParams>(m, "AugmentationParams")
+		.def(py::init<>())
+		.def_readwrite("num_generate", &AugmentationParams::num_generate)
+		.def_readwrite("yaw_sigma", &AugmentationParams::yaw_sigma)
+		.def_readwrite("pitch_sigma", &AugmentationParams::pitch_sigma)
+		.def_readwrite("roll_sigma", &AugmentationParams::roll_sigma)
+		.def_readwrite("blur_max_sigma", &AugmentationParams::blur_max_sigma)
+		.def_readwrite("noise_max_sigma", &AugmentationParams::noise_max_sigma)
+		.def_readwrite("x_slide_sigma", &AugmentationParams::x_slide_sigma)
+		.def_readwrite("y_slide_sigma", &AugmentationParams::y_slide_sigma)
+		.def_readwrite("aspect_sigma", &AugmentationParams::aspect_sigma)
+		.def_readwrite("hflip_ratio", &AugmentationParams::hflip_ratio)
+		.def_readwrite("vflip_ratio", &AugmentationParams::vflip_ratio)
+		.def_readwrite("brightness_sigma", &AugmentationParams::brightness_sigma)
+		.def_readwrite("contrast_sigma", &AugmentationParams::contrast_sigma)
+		.def_readwrite("gamma_sigma", &AugmentationParams::gamma_sigma)
+		.def_readwrite("hue_sigma", &AugmentationParams::hue_sigma)
+		.def_readwrite("saturation_sigma", &AugmentationParams::saturation_sigma)
+		.def_readwrite("min_visible_ratio", &AugmentationParams::min_visible_ratio)
+		.def_readwrite("load_unchanged", &AugmentationParams::load_unchanged)
+		.def_readwrite("seed", &AugmentationParams::seed)
+		.def_readwrite("yaw_sweep", &AugmentationParams::yaw_sweep)
+		.def_readwrite("pitch_sweep", &AugmentationParams::pitch_sweep)
+		.def_readwrite("roll_sweep", &AugmentationParams::roll_sweep)
+		.def_property("output_size",
+			[](const AugmentationParams& p){ return py::make_tuple(p.output_size.width, p.output_size.height); },
+			[](AugmentationParams& p, const std::vector<int>& size){
+				if (size.size() != 2)
+					throw std::invalid_argument("output_size must be (width, height)");
+				p.output_size = cv::Size(size[0], size[1]);
+			});
+
+	m.def("load", &Load, "Load image file (with alpha channel and 16 bit depth if params.load_unchanged)",
+		py::arg("file"), py::arg("params"));
+
+	m.def("transform", &Transform, "Transform area of image randomly",
+		py::arg("img").noconvert(), py::arg("area"), py::arg("params"), py::arg("seed") = py::none());
+
+	m.def("transform_with_rects", &TransformWithRects, "Transform whole image and rectangles on it together",
+		py::arg("img").noconvert(), py::arg("rects"), py::arg("params"), py::arg("seed") = py::none());
+
+	m.def("transform_sweep", &TransformSweep, "Transform area of image at every pose of yaw_sweep, pitch_sweep, and roll_sweep",
+		py::arg("img").noconvert(), py::arg("area"), py::arg("params"), py::arg("seed") = py::none());
+}
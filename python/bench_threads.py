@@ -0,0 +1,97 @@
+# Thread scaling benchmark of DataAugmentation (needs numpy and OpenCV for Python to make input images)
+#
+#   python bench_threads.py <DataAugmentation executable> [--threads 1,2,4,8,16,32,64] [--images 256] [--size 1920x1080]
+#
+# Synthetic JPEG images are written to a temporary folder (or <--input> is used), and the executable is run
+# once for each number of threads with <stats_file>. images_per_sec of the final report, speedup over the first
+# run, and utilization_percent are printed for every run.
+# Give the number of threads beyond the number of cores to see how oversubscription behaves.
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+
+# Random textured images, so that JPEG decode and encode take realistic time
+def make_images(folder, num, width, height):
+	import numpy as np
+	import cv2
+	rng = np.random.RandomState(0)
+	for i in range(num):
+		small = rng.randint(0, 256, (height // 16 + 1, width // 16 + 1, 3)).astype(np.uint8)
+		img = cv2.resize(small, (width, height), interpolation=cv2.INTER_CUBIC)
+		img = cv2.add(img, rng.randint(0, 32, img.shape).astype(np.uint8))
+		cv2.imwrite(os.path.join(folder, "img%04d.jpg" % i), img, [cv2.IMWRITE_JPEG_QUALITY, 90])
+
+
+# Configuration which applies every transformation
+def write_config(path, num_threads, stats_file, args):
+	with open(path, "w") as f:
+		f.write("generate_num=%d\n" % args.generate_num)
+		f.write("yaw_sigma=10\npitch_sigma=10\nroll_sigma=10\n")
+		f.write("blur_max_sigma=1\nnoise_max_sigma=5\n")
+		f.write("horizontal_flip=0.5\n")
+		f.write("num_threads=%d\n" % num_threads)
+		f.write("stats_file=%s\n" % stats_file)
+		if args.output_size:
+			w, h = args.output_size.split("x")
+			f.write("output_width=%s\noutput_height=%s\n" % (w, h))
+
+
+def run(executable, input_path, work, num_threads, args):
+	output = os.path.join(work, "out%d" % num_threads)
+	if os.path.exists(output):
+		shutil.rmtree(output)
+	os.makedirs(output)
+	config = os.path.join(work, "config%d.txt" % num_threads)
+	stats_file = os.path.join(work, "stats%d.json" % num_threads)
+	write_config(config, num_threads, stats_file, args)
+	subprocess.check_call([executable, input_path, output, "-c", config,
+		"-a", os.path.join(work, "annotation%d.txt" % num_threads)], stdout=subprocess.DEVNULL)
+	with open(stats_file) as f:
+		stats = json.load(f)
+	shutil.rmtree(output)
+	return stats
+
+
+def main():
+	parser = argparse.ArgumentParser(description="Thread scaling benchmark of DataAugmentation")
+	parser.add_argument("executable")
+	parser.add_argument("--threads", default="1,2,4,8,16,32,64")
+	parser.add_argument("--input", default="", help="folder of input images (synthetic images if empty)")
+	parser.add_argument("--images", type=int, default=256)
+	parser.add_argument("--size", default="1920x1080")
+	parser.add_argument("--generate_num", type=int, default=4)
+	parser.add_argument("--output_size", default="", help="e.g. 224x224")
+	args = parser.parse_args()
+
+	work = tempfile.mkdtemp(prefix="da_bench_")
+	try:
+		input_path = args.input
+		if not input_path:
+			input_path = os.path.join(work, "input")
+			os.makedirs(input_path)
+			width, height = [int(v) for v in args.size.split("x")]
+			make_images(input_path, args.images, width, height)
+
+		print("cores: %d" % os.cpu_count())
+		print("threads  images/s  speedup  utilization%  peak_rss_mb")
+		base = None
+		for num_threads in [int(v) for v in args.threads.split(",")]:
+			stats = run(args.executable, input_path, work, num_threads, args)
+			rate = stats["images_per_sec"]
+			if base is None:
+				base = rate
+			print("%7d  %8.1f  %7.2f  %12.1f  %11.1f" % (num_threads, rate, rate / base if base else 0,
+				stats["utilization_percent"], stats["peak_rss_mb"]))
+			sys.stdout.flush()
+	finally:
+		shutil.rmtree(work)
+
+
+if __name__ == "__main__":
+	main()
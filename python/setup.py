@@ -0,0 +1,81 @@
+# Build of DataAugmentationPy, the Python binding of DataAugmentation (needs pybind11, OpenCV and boost)
+#
+#   cd python
+#   python setup.py build_ext --inplace
+#
+# OpenCV is found by pkg-config (opencv4 or opencv). Other installations are given by environment variables:
+#   OPENCV_INCLUDE_DIR, OPENCV_LIB_DIR, OPENCV_LIBS (e.g. "opencv_world490")
+#   BOOST_INCLUDE_DIR, BOOST_LIB_DIR, BOOST_LIBS (default "boost_filesystem" and "boost_system")
+# Values are separated by os.pathsep.
+# Set HAVE_LIBJPEG_TURBO=1 to decode only the regions of JPEG images which samples need (links JPEG_LIB, default "jpeg").
+
+import os
+import subprocess
+import sys
+from setuptools import setup
+from pybind11.setup_helpers import Pybind11Extension, build_ext
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+# Sources of the library (everything except main.cpp). Keep in sync with "2. Install" of readme.txt.
+LIBRARY_SOURCES = [
+	"DataAugmentation.cpp",
+	"RandomRotation.cpp",
+	"TransformKernels.cpp",
+	"ImageLoader.cpp",
+	"OutputCache.cpp",
+	"Progress.cpp",
+	"Scheduler.cpp",
+	"FileScanner.cpp",
+	"PlanLog.cpp",
+	"Util.cpp",
+]
+
+
+# Paths or names separated by os.pathsep
+def env_list(name):
+	return [v for v in os.environ.get(name, "").split(os.pathsep) if v]
+
+
+# Include dirs, library dirs and libraries of OpenCV by pkg-config, or by environment variables
+def opencv_flags():
+	if "OPENCV_INCLUDE_DIR" in os.environ or "OPENCV_LIBS" in os.environ:
+		return env_list("OPENCV_INCLUDE_DIR"), env_list("OPENCV_LIB_DIR"), env_list("OPENCV_LIBS")
+	for package in ("opencv4", "opencv"):
+		try:
+			cflags = subprocess.check_output(["pkg-config", "--cflags-only-I", package]).decode().split()
+			libs = subprocess.check_output(["pkg-config", "--libs", package]).decode().split()
+		except (OSError, subprocess.CalledProcessError):
+			continue
+		return ([f[2:] for f in cflags], [f[2:] for f in libs if f.startswith("-L")],
+			[f[2:] for f in libs if f.startswith("-l")])
+	sys.exit("OpenCV is not found. Set OPENCV_INCLUDE_DIR, OPENCV_LIB_DIR and OPENCV_LIBS.")
+
+
+include_dirs, library_dirs, libraries = opencv_flags()
+include_dirs += [ROOT] + env_list("BOOST_INCLUDE_DIR")
+library_dirs += env_list("BOOST_LIB_DIR")
+# MSVC links boost by auto-linking unless BOOST_LIBS is given
+libraries += env_list("BOOST_LIBS") or ([] if sys.platform == "win32" else ["boost_filesystem", "boost_system"])
+
+define_macros = []
+if os.environ.get("HAVE_LIBJPEG_TURBO", "0") != "0":
+	define_macros.append(("HAVE_LIBJPEG_TURBO", None))
+	libraries.append(os.environ.get("JPEG_LIB", "jpeg"))
+
+ext = Pybind11Extension(
+	"DataAugmentationPy",
+	["DataAugmentationPy.cpp"] + [os.path.join(ROOT, f) for f in LIBRARY_SOURCES],
+	include_dirs=include_dirs,
+	library_dirs=library_dirs,
+	libraries=libraries,
+	define_macros=define_macros,
+	cxx_std=11,
+)
+
+setup(
+	name="DataAugmentationPy",
+	description="Python binding of DataAugmentation",
+	ext_modules=[ext],
+	cmdclass={"build_ext": build_ext},
+)
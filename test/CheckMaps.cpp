@@ -0,0 +1,76 @@
+/*M///////////////////////////////////////////////////////////////////////////////////////
+//
+//  IMPORTANT: READ BEFORE DOWNLOADING, COPYING, INSTALLING OR USING.
+//
+//  By downloading, copying, installing or using the software you agree to this license.
+//  If you do not agree to this license, do not download, install,
+//  copy or use the software.
+//
+//
+//                           License Agreement
+//
+// Copyright (C) 2014 Takuya MINAGAWA.
+// Third party copyrights are property of their respective owners.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+// PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+//M*/
+
+/**********************************************
+CheckMaps:
+Test of accuracy of rotation maps computed in float.
+Build it with the library sources instead of main.cpp. It exits with 0 if every error is under 1/32 pixel.
+***********************************************/
+
+
+#include <iostream>
+#include "../RandomRotation.h"
+
+
+// Check error of float maps against double over the whole range of angles
+bool CheckMapAccuracy(bool guardrail)
+{
+	// Areas of the last two sizes end with partial blocks of float maps
+	const cv::Size src_sizes[] = { cv::Size(640, 480), cv::Size(4000, 3000) };
+	const cv::Size area_sizes[] = { cv::Size(64, 64), cv::Size(256, 256), cv::Size(150, 100), cv::Size(333, 97) };
+	const float angle_step = 15;
+	const double max_error = 1.0 / 32;
+
+	bool ok = true;
+	for (int i = 0; i < sizeof(src_sizes) / sizeof(src_sizes[0]); i++){
+		for (int j = 0; j < sizeof(area_sizes) / sizeof(area_sizes[0]); j++){
+			double error = MaxFloatMapError(src_sizes[i], area_sizes[j], angle_step, guardrail);
+			std::cout << (guardrail ? "with" : "without") << " guardrail, source " << src_sizes[i].width << "x" << src_sizes[i].height
+				<< ", area " << area_sizes[j].width << "x" << area_sizes[j].height << ": max error " << error << " pixel" << std::endl;
+			if (!(error < max_error)){
+				ok = false;
+			}
+		}
+	}
+	std::cout << (ok ? "OK" : "NG") << " (limit " << max_error << " pixel)" << std::endl;
+	return ok;
+}
+
+
+int main(int argc, char * argv[])
+{
+	// Float path itself, and maps used for warps
+	bool ok = CheckMapAccuracy(false);
+	ok = CheckMapAccuracy(true) && ok;
+	return ok ? 0 : 1;
+}